@@ -0,0 +1,70 @@
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * This is a host program (it is not built for the microcontroller). It loads an
+ * executable into simavr, releases the simulated microcontroller from reset and
+ * counts the cycles until the program counter reaches main. That number is the
+ * time crt.s spends putting the microcontroller into the state main expects
+ * (vector table -> __init -> __load_data -> __zero_bss -> __call_main).
+ *
+ * @usage:
+ * >> boot-cycles <mcu> <executable.elf> <address of main in hex>
+ *
+ * The makefile in this directory runs it against every example and lesson and
+ * looks up the address of main with avr-nm for you.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+
+/**
+ * we give up if main has not been reached after this many cycles. Something is
+ * wrong with the executable (or crt.s) at that point.
+ */
+#define BOOT_CYCLE_LIMIT 10000000UL
+
+int main(int argc, char *argv[]) {
+  if (argc != 4) {
+    fprintf(stderr, "usage: %s <mcu> <executable.elf> <main address>\n",
+            argv[0]);
+    return 2;
+  }
+
+  elf_firmware_t firmware = {0};
+  if (elf_read_firmware(argv[2], &firmware) != 0) {
+    fprintf(stderr, "%s: could not read %s\n", argv[0], argv[2]);
+    return 1;
+  }
+
+  // our executables do not carry the .mmcu section so the mcu is passed in
+  avr_t *avr = avr_make_mcu_by_name(argv[1]);
+  if (!avr) {
+    fprintf(stderr, "%s: unknown mcu %s\n", argv[0], argv[1]);
+    return 1;
+  }
+  avr_init(avr);
+  avr->frequency = 16000000;
+  avr_load_firmware(avr, &firmware);
+
+  // simavr keeps the program counter as a byte address, same as avr-nm
+  avr_flashaddr_t main_address = (avr_flashaddr_t)strtoul(argv[3], NULL, 16);
+
+  int state = cpu_Running;
+  while (avr->pc != main_address) {
+    state = avr_run(avr);
+    if (state == cpu_Done || state == cpu_Crashed ||
+        avr->cycle > BOOT_CYCLE_LIMIT) {
+      fprintf(stderr, "%s: main was never reached\n", argv[2]);
+      return 1;
+    }
+  }
+
+  printf("%-56s %10llu\n", argv[2], (unsigned long long)avr->cycle);
+  return 0;
+}
@@ -15,6 +15,65 @@
     * (default.ld) uses our implementation (this file) of these routines.
     **/
 
+    /**
+    * crt.s has a few optional startup modes. They are selected when crt.o is assembled by
+    * passing --defsym <OPTION>=1 to avr-as (see the makefile in this directory). Every
+    * option defaults to 0 (off) so the default startup path is unchanged.
+    *
+    * CRT_WARM_BOOT: skip __load_data and __zero_bss after a watchdog or brown-out reset.
+    * CRT_PAINT_STACK: fill the free SRAM between __HEAP_START and the stack with 0xC5.
+    * CRT_BOOT_PROFILE: time every startup stage with Timer1 into __boot_profile (.noinit).
+    * CRT_MULTI_IMAGE: build the loader of a multi-image flash (see __dispatch and loader.ld).
+    **/
+    .ifndef CRT_WARM_BOOT
+    .set CRT_WARM_BOOT, 0
+    .endif
+    .ifndef CRT_PAINT_STACK
+    .set CRT_PAINT_STACK, 0
+    .endif
+    .ifndef CRT_BOOT_PROFILE
+    .set CRT_BOOT_PROFILE, 0
+    .endif
+    .ifndef CRT_MULTI_IMAGE
+    .set CRT_MULTI_IMAGE, 0
+    .endif
+    /**
+    * the loader only runs __dispatch, the stages the other options change are not part of it
+    **/
+    .if CRT_MULTI_IMAGE && (CRT_WARM_BOOT || CRT_PAINT_STACK || CRT_BOOT_PROFILE)
+    .error "CRT_MULTI_IMAGE can not be combined with the other startup options"
+    .endif
+
+    /**
+    * The parts of crt.s that depend on the microcontroller (size of the vector table, top of
+    * SRAM) come from mcu.inc. There is one per supported MCU in /common/mcu/<mcu>/ and the
+    * makefile picks it with -I mcu/$(MCU_TARGET). Everything else in this file is the same
+    * for every AVR we support.
+    **/
+    .include "mcu.inc"
+
+    /**
+    * the canary word malloc keeps at __HEAP_LIMIT (see heap_check in malloc.h). Written at
+    * boot, before main can use any of the stack.
+    **/
+    .set HEAP_CANARY, 0x5AA5           ;keep in sync with malloc.h
+
+    /**
+    * Boot profiling. __init starts Timer1 with no prescaler, so TCNT1 counts CPU cycles since
+    * (almost) the reset vector. At the end of each startup stage this macro copies TCNT1 into
+    * the 16-bit slot at __boot_profile + offset. TCNT1 must be read low byte first, reading
+    * TCNT1L latches TCNT1H. Timer1 wraps after 65536 cycles (4ms at 16MHz) which is far more
+    * than crt.s needs for 2K of SRAM. Without CRT_BOOT_PROFILE the macro expands to nothing.
+    **/
+    .macro boot_timestamp offset
+    .if CRT_BOOT_PROFILE
+    lds r24, 0x84                      ;TCNT1L
+    lds r25, 0x85                      ;TCNT1H
+    sts __boot_profile + \offset, r24
+    sts __boot_profile + \offset + 1, r25
+    .endif
+    .endm
+
     /**
     * This macro is used to define the vectors (minus reset vector) in 
     * the vector table. The name passed to the macro is defined in the
@@ -32,6 +91,18 @@
     .set    \name, __bad_interrupt
     jmp    \name
     .endm
+
+    /**
+    * The number of vectors differs between microcontrollers (26 on the atmega328p, 57 on the
+    * atmega2560) so we do not write them out by hand. vector_n builds the name __vector_<n>
+    * from a number. In .altmacro mode %expr is replaced by the value of expr, which lets
+    * the .rept loop in the vector table count from 1 to __VECTOR_COUNT - 1.
+    **/
+    .altmacro
+    .macro  vector_n n
+    vector  __vector_\n
+    .endm
+    .noaltmacro
 	
     /**
     * @vector_table
@@ -68,31 +139,13 @@
 	.func   __vectors
 __vectors:
 	jmp    __init
-	vector  __vector_1 ;notice how we use the macro defined above.
-	vector  __vector_2
-	vector  __vector_3
-	vector  __vector_4
-	vector  __vector_5
-    vector  __vector_6
-    vector  __vector_7
-    vector  __vector_8
-    vector  __vector_9
-    vector  __vector_10
-    vector  __vector_11
-    vector  __vector_12
-    vector  __vector_13
-    vector  __vector_14
-    vector  __vector_15
-    vector  __vector_16
-    vector  __vector_17
-    vector  __vector_18
-    vector  __vector_19
-    vector  __vector_20
-    vector  __vector_21
-    vector  __vector_22
-    vector  __vector_23
-    vector  __vector_24
-    vector  __vector_25
+    .set __vector_index, 1
+    .rept __VECTOR_COUNT - 1
+    .altmacro
+    vector_n %__vector_index          ;vector __vector_1, vector __vector_2, ...
+    .noaltmacro
+    .set __vector_index, __vector_index + 1
+    .endr
     .endfunc
 
     /**
@@ -118,11 +171,26 @@ __bad_interrupt:
     * What should we do from here? The objective of this file is to call our main function.
     * Doing this means we will setup the environment that our main function expects.
     * We will zero out the (r1) register as expected by compiler. 
-    * We will also zero out the status register. We will set the stack register to 0x08FF 
-    * which is the top of SRAM. The stack register is implemented as (2) 8-bit registers 
+    * We will also zero out the status register. We will set the stack register to RAMEND
+    * (mcu.inc, 0x08FF on the atmega328p) which is the top of SRAM. The stack register is implemented as (2) 8-bit registers 
     * in the AVR architecture. This can be seen in the datasheet. That means moving the top
     * 8 bits of the stack pointer into the high byte of the stack pointer register and the
     * bottom 8 bits into the low byte of the stack pointer register.
+    *
+    * Next we find out why we were reset. The MCU Status Register (MCUSR, I/O address 0x34)
+    * holds one flag per reset source:
+    *
+    *   bit 0 PORF  power-on reset
+    *   bit 1 EXTRF external reset (reset pin)
+    *   bit 2 BORF  brown-out reset
+    *   bit 3 WDRF  watchdog reset
+    *
+    * The flags are only cleared by a power-on reset or by writing zero to them, so we save
+    * them to __reset_cause and clear the register. __reset_cause lives in the .noinit section
+    * which is never touched by __load_data or __zero_bss. After a watchdog reset the watchdog
+    * is still running (WDRF forces WDE on) so we also switch it off, otherwise main would be
+    * reset again before it had a chance to configure it. Turning the watchdog off requires
+    * writing WDCE and WDE together and then zero within four cycles (WDTCSR, address 0x60).
     **/
     .section .init,"ax",@progbits
     .weak __init
@@ -130,13 +198,84 @@ __bad_interrupt:
 __init:
     clr r1        ;set the zero register to zero
     out 0x3F, r1  ;zero out the status register
-    ldi r28, 0x08
+    .if CRT_BOOT_PROFILE
+    sts 0x85, r1  ;TCNT1H <-- 0 (high byte first when writing)
+    sts 0x84, r1  ;TCNT1L <-- 0
+    ldi r24, 0x01
+    sts 0x81, r24 ;TCCR1B <-- CS10, Timer1 counts every cycle
+    sts __boot_profile + 0, r1 ;stages skipped by a warm boot read as 0
+    sts __boot_profile + 1, r1
+    sts __boot_profile + 2, r1
+    sts __boot_profile + 3, r1
+    sts __boot_profile + 4, r1
+    sts __boot_profile + 5, r1
+    .endif
+    ldi r28, hi8(RAMEND)
     out 0x3E, r28 ;set stack pointer high byte
-    ldi r28, 0xFF
+    ldi r28, lo8(RAMEND)
     out 0x3D, r28 ;set stack pointer low byte
+    in r24, 0x34  ;r24 <-- MCUSR (reset cause)
+    out 0x34, r1  ;clear all reset flags
+    sts __reset_cause, r24
+    ldi r25, 0x18
+    sts 0x60, r25 ;WDTCSR <-- WDCE | WDE
+    sts 0x60, r1  ;WDTCSR <-- 0, watchdog off
+    .if CRT_MULTI_IMAGE
+    sbrc r24, 0   ;PORF set, __image_select is garbage, boot slot 0
+    sts __image_select, r1
+    rjmp __dispatch                    ;the loader has no .data, .bss or main of its own
+    .else
+    /**
+    * Warm boot: when the reset came from the watchdog or a brown-out (and not from power
+    * coming up) SRAM still holds everything the program had before the reset. We skip
+    * __load_data and __zero_bss and go straight to main so counters, ring buffers or the
+    * last error survive the reset. A power-on reset always takes the full (cold) path.
+    **/
+    .if CRT_WARM_BOOT
+    sbrc r24, 0   ;PORF set, SRAM content is garbage, take the cold path
+    rjmp __load_data
+    andi r24, 0x0C ;keep BORF and WDRF
+    breq __cold_boot
+    lds r24, __reset_cause
+    ori r24, 0x80  ;bit 7 (unused by MCUSR) tells main the warm path was taken
+    sts __reset_cause, r24
+    rjmp __call_main
+__cold_boot:
+    .endif
     rjmp __load_data
+    .endif
     .endfunc
 
+    /**
+    * The reset cause saved by __init. It is placed in .noinit so it survives __zero_bss
+    * (and any reset). See boot.h in utils for the C side.
+    **/
+    .section .noinit,"aw",@nobits
+    .global __reset_cause
+__reset_cause:
+    .skip 1
+
+    /**
+    * The boot profile written when crt.o is built with CRT_BOOT_PROFILE. Four 16-bit Timer1
+    * counts: end of __load_data, end of __zero_bss, end of __paint_stack, entry of
+    * __call_main. The layout matches boot_profile_t in boot.h.
+    **/
+    .if CRT_BOOT_PROFILE
+    .global __boot_profile
+__boot_profile:
+    .skip 8
+    .endif
+
+    /**
+    * The image slot __dispatch boots. It sits right after __reset_cause so image.ld can keep
+    * both bytes out of the way of the images (.noinit of the loader starts at ORIGIN(SRAM)).
+    **/
+    .if CRT_MULTI_IMAGE
+    .global __image_select
+__image_select:
+    .skip 1
+    .endif
+
     /**
     * The main function expects the data defined by the program located in the .data section
     * of the executable object file to be located in SRAM. It is then our job to copy this data
@@ -153,55 +292,132 @@ __load_data:
     * the data in flash. Notice how we increment the Z pointer with Z+. Next we store the
     * data loaded into r0 into the SRAM pointed to by the Y pointer. This is an example of
     * a useful addressing mode.
+    *
+    * The X pointer is not used as a pointer here. It holds the number of bytes left to copy
+    * (__data_bytes_to_read from default.ld). Counting down a register pair with [sbiw] is
+    * cheaper than comparing two pointers on every byte.
+    **/
+    ldi r30, lo8(__data_start_flash)   ;low(Z)  <-- low byte of (uint8_t*)__data_start_flash
+    ldi r31, hi8(__data_start_flash)   ;high(Z) <-- high byte of (uint8_t*)__data_start_flash
+    ldi r28, lo8(__data_start_sram)    ;low(Y)  <-- low byte of (uint8_t*)__data_start_sram
+    ldi r29, hi8(__data_start_sram)    ;high(Y) <-- high byte of (uint8_t*)__data_start_sram
+    ldi r26, lo8(__data_bytes_to_read) ;low(X)  <-- low byte of SIZEOF(.data)
+    ldi r27, hi8(__data_bytes_to_read) ;high(X) <-- high byte of SIZEOF(.data)
+    /**
+    * The linker script aligns the end of .data to 2 bytes so the count is always even. The
+    * loop below moves 4 bytes per pass. If the count is not a multiple of 4 we copy the odd
+    * word here first and drop it from the count.
     **/
-    ldi r17, hi8(__data_end_sram)    ;r17     <-- high byte of (uint8_t*)__data_end_sram
-    ldi r30, lo8(__data_start_flash) ;low(Z)  <-- low byte of (uint8_t*)__data_start_flash
-    ldi r31, hi8(__data_start_flash) ;high(Z) <-- high byte of (uint8_t*)__data_start_flash
-    ldi r28 , lo8(__data_start_sram) ;low(Y)  <-- low byte of (uint8_t*)__data_start_sram
-    ldi r29 , hi8(__data_start_sram) ;high(Y) <-- high byte of (uint8_t*)__data_start_sram
+    sbrs r26, 1                        ;skip the next instruction if bit 1 of the count is set
+    rjmp __load_data_start
+    lpm r0, Z+
+    st Y+, r0
+    lpm r0, Z+
+    st Y+, r0
+    andi r26, 0xFC                     ;the count is now a multiple of 4
     rjmp __load_data_start
     .endfunc
     /**
     * next we load a byte from flash (.data byte) at [Z pointer] into r0 and 
     * increment Z. We will store the value [r0] into the SRAM, at location Y.
+    * The loop body is unrolled four times so the loop overhead (sbiw + brcc) is
+    * paid once per 4 bytes instead of the compare and branch on every byte.
     **/
     .func __load_data_loop
 __load_data_loop:
     lpm r0, Z+ ;load the byte from flash
     st Y+, r0  ;store the byte in sram
+    lpm r0, Z+
+    st Y+, r0
+    lpm r0, Z+
+    st Y+, r0
+    lpm r0, Z+
+    st Y+, r0
     /**
-    * next we need to check if we have reached the end of the .data section. We will do
-    * this by comparing the Z pointer to the end of the .data section. If we have not 
-    * reached the end of the .data section we will loop back and load the next byte from 
-    * flash into r0 and store it in SRAM. 
+    * next we need to check if there are bytes left to copy. We take 4 from the count,
+    * when the subtraction borrows (carry set) the count was 0 and we are done. Otherwise
+    * we loop back and copy the next 4 bytes.
     **/
 __load_data_start:
-    cpi  r28, lo8(__data_end_sram)
-    cpc r17, r29
-    brne __load_data_loop
+    sbiw r26, 4
+    brcc __load_data_loop
+    boot_timestamp 0                   ;__boot_profile.load_data
+    rjmp __zero_bss                    ;jump to the routine that clears .bss
     .endfunc
 
     /**
     * n bytes must be allocated in SRAM for the .bss where n = SIZEOF(.bss). These allocated bytes must be 
     * initialized to zero. The .bss section contains the uninitialized global and static variables 
-    * (e.g uint8_t value). 
+    * (e.g uint8_t value). Like __load_data we count down __bss_bytes_to_clear (even, see default.ld)
+    * 4 bytes at a time. The zero we store comes from r1 which __init has already cleared.
     **/
     .section .zero_bss,"aw",@progbits
     .global __zero_bss
     .func __zero_bss
 __zero_bss:
-    ldi r30, lo8(__bss_start_sram) ;set Z pointer low byte to the low byte of ADDR(.bss section)
-    ldi r31, hi8(__bss_start_sram) ;set Z pointer high byte to the high byte of ADDR(.bss section)
-    ldi r28, lo8(__bss_end_sram)   ;set Y pointer low byte to the low byte of ADDR(__bss_end)
-    ldi r29, hi8(__bss_end_sram)   ;set Y pointer high byte to the high byte of ADDR(__bss_end)
+    ldi r30, lo8(__bss_start_sram)     ;set Z pointer low byte to the low byte of ADDR(.bss section)
+    ldi r31, hi8(__bss_start_sram)     ;set Z pointer high byte to the high byte of ADDR(.bss section)
+    ldi r26, lo8(__bss_bytes_to_clear) ;low(X)  <-- low byte of SIZEOF(.bss)
+    ldi r27, hi8(__bss_bytes_to_clear) ;high(X) <-- high byte of SIZEOF(.bss)
+    sbrs r26, 1                        ;skip the next instruction if bit 1 of the count is set
+    rjmp __zero_bss_start
+    st Z+, r1                          ;clear the odd word first
+    st Z+, r1
+    andi r26, 0xFC                     ;the count is now a multiple of 4
+    rjmp __zero_bss_start
 __zero_bss_loop:
-    cpi r30, lo8(__bss_end_sram)   ;compare the low byte of Z to the low byte of ADDR(__bss_end)
-    cpc r31, r29                   ;compare with carry the high byte of Z to the high byte of ADDR(__bss_end)
-    breq __zero_bss_end            ;if they are equal jump to end of function
-    st Z+, r0                      ;store zero in the SRAM pointed to by Z and increment Z
-    jmp __zero_bss_loop            ;loop back
-__zero_bss_end:
-    rjmp __call_main               ;jump to the main function
+    st Z+, r1                          ;store zero in the SRAM pointed to by Z and increment Z
+    st Z+, r1
+    st Z+, r1
+    st Z+, r1
+__zero_bss_start:
+    sbiw r26, 4                        ;4 less bytes to clear, carry is set once we go past zero
+    brcc __zero_bss_loop               ;loop back
+    boot_timestamp 2                   ;__boot_profile.zero_bss
+    rjmp __paint_stack                 ;jump to the stack painting routine
+    .endfunc
+
+    /**
+    * Stack painting. Everything between the end of our static data (__HEAP_START, see
+    * default.ld) and the stack pointer is free SRAM shared by the heap and the stack. We fill
+    * it with a known pattern (0xC5). The stack grows down into this area, every push and
+    * every stack frame overwrites the pattern. Later we can scan up from __HEAP_LIMIT to find
+    * the lowest address the stack has ever reached (see stack.h in utils).
+    *
+    * The stack is empty at this point so SP itself is the highest free byte, we paint up to
+    * and including it. Painting costs about 6 cycles per free byte, which is why it is
+    * optional (CRT_PAINT_STACK).
+    *
+    * After the paint (it would cover it) we always write the heap canary at __HEAP_LIMIT,
+    * the lowest 2 bytes of the stack reserve. malloc can check it from the first
+    * instruction of main, and the stack is empty so nothing lives there yet. A warm boot
+    * skips this like the rest of the cold path, the canary stays what it was in SRAM.
+    **/
+    .section .paint_stack,"ax",@progbits
+    .global __paint_stack
+    .func __paint_stack
+__paint_stack:
+    .if CRT_PAINT_STACK
+    ldi r30, lo8(__HEAP_START)         ;Z <-- first free byte after .data/.bss/.noinit
+    ldi r31, hi8(__HEAP_START)
+    in r28, 0x3D                       ;Y <-- stack pointer
+    in r29, 0x3E
+    adiw r28, 1                        ;Y <-- SP + 1, the byte after the last one we paint
+    ldi r24, 0xC5                      ;the paint pattern
+    rjmp __paint_stack_start
+__paint_stack_loop:
+    st Z+, r24
+__paint_stack_start:
+    cp r30, r28
+    cpc r31, r29
+    brlo __paint_stack_loop            ;Z < Y, keep painting
+    boot_timestamp 4                   ;__boot_profile.paint_stack
+    .endif
+    ldi r24, lo8(HEAP_CANARY)
+    sts __HEAP_LIMIT, r24              ;the canary, low byte first
+    ldi r24, hi8(HEAP_CANARY)
+    sts __HEAP_LIMIT + 1, r24
+    rjmp __call_main                   ;jump to the main function
     .endfunc
 
     /**
@@ -212,6 +428,12 @@ __zero_bss_end:
     .global __call_main
     .func __call_main
 __call_main:
+    boot_timestamp 6                   ;__boot_profile.call_main
+    .if CRT_BOOT_PROFILE
+    sts 0x81, r1 ;TCCR1B <-- 0, stop Timer1 and hand it to main in its reset state
+    sts 0x85, r1
+    sts 0x84, r1
+    .endif
     out 0x3F, r1 ;clear the status register
     sei          ;enable interrupts
     call main    ;call the main function
@@ -219,6 +441,133 @@ __call_main:
     rjmp __exit   ;jump to the exit function
     .endfunc
 
+    /**
+    * Multi-image flash. With CRT_MULTI_IMAGE crt.o becomes a loader: it owns the vector table
+    * and the first bytes of flash, and up to IMAGE_SLOTS independent applications are linked
+    * into fixed flash slots with image.ld. Every image starts with a header that image.ld
+    * writes (SHORT() statements), 8 words:
+    *
+    *   IMAGE_MAGIC | entry (word address) | .data in flash | .data in SRAM | .data bytes |
+    *   .bss in SRAM | .bss bytes | __HEAP_LIMIT
+    *
+    * __init jumps here instead of __load_data. We try the slot in __image_select (a .noinit
+    * byte, so a program can pick the image for the next reset, see boot.h) and if it does
+    * not hold a valid image every slot in order. For the image we boot we do what
+    * __load_data and __zero_bss do for a normal executable, with the addresses read from its
+    * header, write the heap canary at its __HEAP_LIMIT (see __paint_stack) and call its
+    * entry. The slot addresses come from loader.ld (__image_slot_<n>),
+    * an unused slot is 0 which never holds the magic (the vector table is there).
+    *
+    * The slots must be in the first 64K of flash, lpm can not read past it. The images do not
+    * get interrupt vectors of their own, the vector table belongs to the loader.
+    **/
+    .if CRT_MULTI_IMAGE
+    .set IMAGE_SLOTS, 4
+    .set IMAGE_MAGIC, 0x1A5E           ;keep in sync with image.ld
+
+    .section .dispatch,"ax",@progbits
+    .global __dispatch
+    .func __dispatch
+__dispatch:
+    lds r24, __image_select
+    rcall __image_try                  ;only returns if the selected slot holds no valid image
+    clr r24
+__dispatch_scan:
+    rcall __image_try                  ;fall back to the first valid slot
+    inc r24
+    cpi r24, IMAGE_SLOTS
+    brlo __dispatch_scan
+    rjmp __exit                        ;no valid image at all
+    .endfunc
+
+    /**
+    * boot the image in slot r24, return if the slot number is out of range or the slot
+    * does not start with IMAGE_MAGIC. This is a run-once routine so the copy loops move a
+    * byte per pass instead of being unrolled like __load_data.
+    **/
+    .func __image_try
+__image_try:
+    cpi r24, IMAGE_SLOTS
+    brsh __image_try_fail
+    mov r30, r24
+    clr r31
+    lsl r30                            ;Z <-- __image_slots + 2 * slot
+    subi r30, lo8(-(__image_slots))
+    sbci r31, hi8(-(__image_slots))
+    lpm r26, Z+                        ;X <-- flash address of the image header
+    lpm r27, Z
+    movw r30, r26
+    lpm r25, Z+
+    cpi r25, lo8(IMAGE_MAGIC)
+    brne __image_try_fail
+    lpm r25, Z+
+    cpi r25, hi8(IMAGE_MAGIC)
+    brne __image_try_fail
+    sts __image_select, r24            ;the slot we boot, the image can read it
+    lpm r16, Z+                        ;r17:r16 <-- entry (word address)
+    lpm r17, Z+
+    lpm r18, Z+                        ;r19:r18 <-- .data in flash
+    lpm r19, Z+
+    lpm r28, Z+                        ;Y <-- .data in SRAM
+    lpm r29, Z+
+    lpm r26, Z+                        ;X <-- .data bytes
+    lpm r27, Z+
+    lpm r20, Z+                        ;r21:r20 <-- .bss in SRAM
+    lpm r21, Z+
+    lpm r22, Z+                        ;r23:r22 <-- .bss bytes
+    lpm r23, Z+
+    lpm r24, Z+                        ;r25:r24 <-- __HEAP_LIMIT
+    lpm r25, Z+
+    movw r30, r18                      ;Z <-- .data in flash
+    rjmp __image_data_start
+__image_data_loop:
+    lpm r0, Z+
+    st Y+, r0
+__image_data_start:
+    sbiw r26, 1                        ;carry is set once we go past zero
+    brcc __image_data_loop
+    movw r30, r20                      ;Z <-- .bss in SRAM
+    movw r26, r22                      ;X <-- .bss bytes
+    rjmp __image_bss_start
+__image_bss_loop:
+    st Z+, r1
+__image_bss_start:
+    sbiw r26, 1
+    brcc __image_bss_loop
+    movw r30, r24                      ;Z <-- __HEAP_LIMIT
+    ldi r24, lo8(HEAP_CANARY)
+    st Z+, r24
+    ldi r24, hi8(HEAP_CANARY)
+    st Z, r24
+    ldi r28, hi8(RAMEND)               ;drop our return addresses, the image gets the whole stack
+    out 0x3E, r28
+    ldi r28, lo8(RAMEND)
+    out 0x3D, r28
+    movw r30, r16                      ;Z <-- entry
+    out 0x3F, r1                       ;clear the status register
+    sei                                ;enable interrupts
+    icall                              ;call the entry of the image
+    cli                                ;disable interrupts
+    rjmp __exit
+__image_try_fail:
+    ret
+    .endfunc
+
+    /**
+    * flash address of the header in every slot, see loader.ld
+    **/
+__image_slots:
+    .word __image_slot_0
+    .word __image_slot_1
+    .word __image_slot_2
+    .word __image_slot_3
+    .endif
+
+    /**
+    * __exit has its own section so the loader (CRT_MULTI_IMAGE, which has no main) can use
+    * it without .call_main.
+    **/
+    .section .exit,"ax",@progbits
     .global __exit
     .func __exit
 __exit:
@@ -234,7 +583,7 @@ __exit:
     .section .crt_version,"S",@progbits
     .global __crt_version_string
 __crt_version_string:
-    .string  "Version 1.1.3"
+    .string  "Version 1.1.10"
     .byte(0)
     
 
@@ -244,5 +593,15 @@ __crt_version_string:
     * Version 1.1.3: Removed __F_CPU symbol. Fixed all hanging functions. 
     * hanging defined as relied on placment in executable to ensure proper
     * program flow. Now all functions explicitly call the next function.
+    * Version 1.1.4: __load_data and __zero_bss count down the byte counts exported by
+    * default.ld and move 4 bytes per loop pass. __zero_bss stores r1 (zero) instead of r0.
+    * Version 1.1.5: Save and clear MCUSR into __reset_cause (.noinit), switch the watchdog
+    * off, optional warm boot path (CRT_WARM_BOOT).
+    * Version 1.1.6: Optional stack painting between __HEAP_START and SP (CRT_PAINT_STACK).
+    * Version 1.1.7: Optional boot profiling with Timer1 (CRT_BOOT_PROFILE).
+    * Version 1.1.8: Vector table size and RAMEND come from mcu/<mcu>/mcu.inc (MCU_TARGET).
+    * Version 1.1.9: Optional multi-image loader with the __dispatch routine (CRT_MULTI_IMAGE).
+    * Version 1.1.10: Write the heap canary at __HEAP_LIMIT at boot, the image header holds
+    * __HEAP_LIMIT of the image.
     **/
 
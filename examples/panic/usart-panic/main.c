@@ -42,6 +42,9 @@ void panic_handler(void_ptr_t arg1) {
   usart0_init(103);
   // send the error message over the USART module
   usart0_transmit_bytes((uint8_ptr_t)arg1);
+  // the message is only queued, the system halts with interrupts disabled
+  // once main returns
+  usart0_flush();
 }
 
 /**
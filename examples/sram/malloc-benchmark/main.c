@@ -0,0 +1,173 @@
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose: Measure how many cycles malloc and free take. The same workload is
+ * linked against malloc.o (power of two free lists) and malloc-tlsf.o (TLSF,
+ * see malloc.h) and run in simavr by malloc-cycles (see the makefile), which
+ * reads the results out of SRAM when the workload is done.
+ *
+ * @important_notes:
+ * Timer1 runs at the CPU clock and every call is timed on its own: TCNT1 is
+ * read right before and right after the call and the cost of the two reads
+ * (measured with nothing in between) is taken off. A call takes far less than
+ * the 65536 cycles Timer1 needs to wrap.
+ *
+ * The workload has two parts:
+ * 1. fragmented: a heap full of free blocks of the same power of two class
+ *    but of different sizes, then requests at the top of that class. This is
+ *    where the power of two lists miss (the head of the class is too small)
+ *    and move on to the classes above.
+ * 2. mixed: pseudo random malloc and free calls on 24 slots, small sizes with
+ *    the occasional buffer, the same sequence on every run.
+ */
+
+#include "avr-arch.h"
+#include "malloc.h"
+#include "types.h"
+
+#define SLOTS 24
+#define FRAGMENTED_BLOCKS 40
+#define MIXED_OPS 600
+
+/**
+ * @implementation_details:
+ * the results, malloc-cycles finds them by their symbol. AVR does not pad
+ * structs, the host tool reads the fields at these byte offsets:
+ *
+ *  0: malloc worst   2: malloc total (32 bit)   6: malloc calls
+ *  8: free worst    10: free total (32 bit)    14: free calls
+ * 16: failed mallocs 18: done (1 when the workload has finished)
+ */
+typedef struct {
+  uint16_t worst;
+  uint32_t total;
+  uint16_t count;
+} cycles_t;
+
+typedef struct {
+  cycles_t malloc_cycles;
+  cycles_t free_cycles;
+  uint16_t failed;
+  uint8_t done;
+} benchmark_t;
+
+volatile benchmark_t benchmark;
+
+static uint8_ptr_t slots[SLOTS];
+static uint8_ptr_t blocks[FRAGMENTED_BLOCKS];
+static uint16_t timer_overhead;
+
+/**
+ * @function:
+ * timer
+ * @return: TCNT1, low byte first (it latches the high byte)
+ */
+static inline uint16_t timer() {
+  uint8_t low = TCNT1L;
+  return ((uint16_t)TCNT1H << 8) | low;
+}
+
+static void record(volatile cycles_t *cycles, uint16_t start, uint16_t end) {
+  uint16_t elapsed = end - start - timer_overhead;
+  if (elapsed > cycles->worst) {
+    cycles->worst = elapsed;
+  }
+  cycles->total += elapsed;
+  cycles->count++;
+}
+
+/**
+ * @function:
+ * timed_malloc / timed_free
+ * @description:
+ * malloc and free with the cycles of the call recorded
+ */
+static void timed_malloc(uint16_t size, uint8_ptr_ptr_t ptr) {
+  uint16_t start = timer();
+  int result = malloc(size, ptr, __LINE__);
+  uint16_t end = timer();
+  record(&benchmark.malloc_cycles, start, end);
+  if (result != 0) {
+    *ptr = 0;
+    benchmark.failed++;
+  }
+}
+
+static void timed_free(uint8_ptr_ptr_t ptr) {
+  if (*ptr == 0) {
+    return;
+  }
+  uint16_t start = timer();
+  free(*ptr);
+  uint16_t end = timer();
+  record(&benchmark.free_cycles, start, end);
+  *ptr = 0;
+}
+
+/**
+ * @function:
+ * next_random
+ * @return: a pseudo random number (xorshift16), the same sequence on every
+ * run so both allocators see the same calls
+ */
+static uint16_t random_state = 1;
+
+static uint16_t next_random() {
+  random_state ^= random_state << 7;
+  random_state ^= random_state >> 9;
+  random_state ^= random_state << 8;
+  return random_state;
+}
+
+static void fragmented() {
+  // blocks of 16 - 31 bytes (one power of two class), every other one is
+  // freed so they can not merge. The smaller ones end up at the list heads.
+  for (uint8_t index = 0; index < FRAGMENTED_BLOCKS; index++) {
+    timed_malloc(31 - (index & 15), &blocks[index]);
+  }
+  for (uint8_t index = 0; index < FRAGMENTED_BLOCKS; index += 2) {
+    timed_free(&blocks[index]);
+  }
+  // requests at the top of the class
+  for (uint8_t index = 0; index < FRAGMENTED_BLOCKS; index += 2) {
+    timed_malloc(30, &blocks[index]);
+  }
+  for (uint8_t index = 0; index < FRAGMENTED_BLOCKS; index++) {
+    timed_free(&blocks[index]);
+  }
+}
+
+static void mixed() {
+  for (uint16_t op = 0; op < MIXED_OPS; op++) {
+    uint16_t roll = next_random();
+    uint8_t slot = (roll >> 8) % SLOTS;
+    if (slots[slot] != 0) {
+      timed_free(&slots[slot]);
+    } else if ((roll & 0x0f) == 0) {
+      timed_malloc(64 + (roll & 0x70), &slots[slot]);
+    } else {
+      timed_malloc(1 + (roll & 0x1f), &slots[slot]);
+    }
+  }
+  for (uint8_t slot = 0; slot < SLOTS; slot++) {
+    timed_free(&slots[slot]);
+  }
+}
+
+int main(void) {
+  // Timer1 counts every CPU cycle
+  TCCR1A = 0;
+  TCCR1B = 1 << CS10;
+  uint16_t start = timer();
+  uint16_t end = timer();
+  timer_overhead = end - start;
+
+  fragmented();
+  mixed();
+
+  benchmark.done = 1;
+  while (1) {
+  }
+}
@@ -0,0 +1,96 @@
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * This is a host program (it is not built for the microcontroller). It runs
+ * the malloc benchmark (main.c in this directory) in simavr until the workload
+ * sets benchmark.done and prints the cycles malloc and free took:
+ *
+ * >> malloc-cycles <mcu> <executable.elf> <address of benchmark in hex>
+ *
+ * The makefile in this directory runs it against both builds of the benchmark
+ * and looks up the address of benchmark with avr-nm for you.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+
+/**
+ * we give up if the workload has not finished after this many cycles
+ */
+#define BENCHMARK_CYCLE_LIMIT 100000000UL
+
+// field offsets of benchmark_t, see main.c
+#define MALLOC_CYCLES 0
+#define FREE_CYCLES 8
+#define FAILED 16
+#define DONE 18
+
+static uint16_t read16(avr_t *avr, uint16_t address) {
+  return avr->data[address] | (avr->data[address + 1] << 8);
+}
+
+static uint32_t read32(avr_t *avr, uint16_t address) {
+  return read16(avr, address) | ((uint32_t)read16(avr, address + 2) << 16);
+}
+
+/**
+ * @function:
+ * print_cycles
+ * @description:
+ * worst and average of one cycles_t
+ */
+static void print_cycles(avr_t *avr, uint16_t address) {
+  uint16_t worst = read16(avr, address);
+  uint32_t total = read32(avr, address + 2);
+  uint16_t count = read16(avr, address + 6);
+  printf(" %6u %8.1f", worst, count ? (double)total / count : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 4) {
+    fprintf(stderr, "usage: %s <mcu> <executable.elf> <benchmark address>\n",
+            argv[0]);
+    return 2;
+  }
+
+  elf_firmware_t firmware = {0};
+  if (elf_read_firmware(argv[2], &firmware) != 0) {
+    fprintf(stderr, "%s: could not read %s\n", argv[0], argv[2]);
+    return 1;
+  }
+
+  // our executables do not carry the .mmcu section so the mcu is passed in
+  avr_t *avr = avr_make_mcu_by_name(argv[1]);
+  if (!avr) {
+    fprintf(stderr, "%s: unknown mcu %s\n", argv[0], argv[1]);
+    return 1;
+  }
+  avr_init(avr);
+  avr->frequency = 16000000;
+  avr_load_firmware(avr, &firmware);
+
+  // avr-nm prints data addresses with the 0x800000 offset of the data space,
+  // simavr indexes avr->data with the address the CPU uses
+  uint16_t benchmark = (uint16_t)(strtoul(argv[3], NULL, 16) & 0xffff);
+
+  while (avr->data[benchmark + DONE] == 0) {
+    int state = avr_run(avr);
+    if (state == cpu_Done || state == cpu_Crashed ||
+        avr->cycle > BENCHMARK_CYCLE_LIMIT) {
+      fprintf(stderr, "%s: the workload never finished\n", argv[2]);
+      return 1;
+    }
+  }
+
+  printf("%-16s", argv[2]);
+  print_cycles(avr, benchmark + MALLOC_CYCLES);
+  print_cycles(avr, benchmark + FREE_CYCLES);
+  printf(" %6u\n", read16(avr, benchmark + FAILED));
+  return 0;
+}
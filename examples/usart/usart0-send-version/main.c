@@ -36,6 +36,7 @@
  * level must be set to -Os. If not it is undefined behavior.
  */
 
+#include "progmem.h"
 #include "types.h"
 #include "usart.h"
 
@@ -54,30 +55,36 @@
  * the wiki on parity bits. They are a simplistic form of error checking.
  */
 
-extern uint8_t __crt_version_string;
+/**
+ * The strings below are only ever read by usart0_transmit_bytes_P so we keep
+ * them in flash with PSTR (see progmem.h). A plain string literal ends up in
+ * .rodata which crt.s copies into SRAM before main, costing us SRAM for text
+ * we never modify. The crt version string is placed in flash by the linker
+ * script (.crt_version) so it must be read from flash as well.
+ */
+extern const uint8_t __crt_version_string;
 
-void foo(uint8_ptr_t str) {
-  usart0_transmit_bytes(str);
+void foo(uint8_flash_ptr_t str) {
+  usart0_transmit_bytes_P(str);
   usart0_transmit_byte(NEW_LINE);
   usart0_transmit_byte(CARRIAGE_RETURN);
-  uint8_ptr_t str3 = "crt version(used to link):";
-  usart0_transmit_bytes(str3);
+  usart0_transmit_bytes_P(PSTR("crt version(used to link):"));
   usart0_transmit_byte(NEW_LINE);
   usart0_transmit_byte(CARRIAGE_RETURN);
-  usart0_transmit_bytes(&__crt_version_string);
+  usart0_transmit_bytes_P(&__crt_version_string);
 }
 
 int main(void) {
   // 16 MHz, 9600 Baud = 103
   uint16_t ubrr = 103;
   usart0_init(ubrr);
-  usart0_transmit_bytes(CLEAR_SCREEN);
-  uint8_ptr_t str = "ping";
-  usart0_transmit_bytes(str);
+  usart0_transmit_bytes_P(PSTR(CLEAR_SCREEN));
+  usart0_transmit_bytes_P(PSTR("ping"));
   usart0_transmit_byte(NEW_LINE);
   usart0_transmit_byte(CARRIAGE_RETURN);
-  uint8_ptr_t str1 = "pong";
-  foo(str1);
+  foo(PSTR("pong"));
+  // crt.s disables interrupts when main returns, send the ring before that
+  usart0_flush();
   return 0;
 }
 
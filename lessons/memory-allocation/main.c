@@ -174,6 +174,15 @@
  *        |           ...            |
  * 0x3ffe |--------------------------|
  *
+ * @multi_image:
+ * The layout above links main.c and prog1.c into one executable. `make
+ * multi-image` builds the real thing: main.o and prog1.o are linked on their
+ * own (common/image.ld) into the flash slots at 0x1000 and 0x4000, each with
+ * its own .data and .bss, and a small loader (crt.s built with
+ * CRT_MULTI_IMAGE, common/loader.ld) at 0x0000 picks one of them at reset.
+ * Look at image_a.map and image_b.map and notice that both images put their
+ * .data at the same SRAM address, only one of them runs at a time.
+ *
  * main.c will have the following sections:
  * - .main_text: stack variables, function code
  * - .data: one global variable that is initialized and one static global that
@@ -0,0 +1,203 @@
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * Trace driven benchmark of malloc.c on the host. It replays allocation traces
+ * against the simulated 2 KB SRAM and reports how fast and how well the
+ * allocator did:
+ *
+ * ./bench traces/usart-frames.trace traces/mixed.trace
+ *
+ * malloc.c debug variant, 200 passes per trace
+ * trace                 ops   ops/sec  failed  peak   max frag  end frag
+ * usart-frames.trace    ...
+ *
+ * ops/sec is host speed, only useful to compare two versions of malloc.c on
+ * the same machine. It includes a heap_stats call after every operation of
+ * the first pass. peak is the highest __HEAP_END of the trace in bytes above
+ * __HEAP_START, max frag the highest heap_fragmentation seen after an
+ * operation, end frag the fragmentation at the end of the trace (before the
+ * remaining blocks are freed).
+ *
+ * @trace_format:
+ * one operation per line, ids name the blocks (0 - TRACE_IDS - 1):
+ *
+ * m <id> <size>   malloc
+ * c <id> <size>   calloc (1 element of size bytes)
+ * r <id> <size>   realloc
+ * f <id>          free
+ * # ...           comment
+ *
+ * Every trace is replayed BENCH_PASSES times. After a pass the blocks that are
+ * still allocated are freed so the next pass starts on an empty heap.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "malloc.h"
+#include "types.h"
+
+// set by the makefile for bench-release and bench-tlsf
+#ifndef MALLOC_RELEASE
+#define MALLOC_RELEASE 0
+#endif
+#ifndef MALLOC_TLSF
+#define MALLOC_TLSF 0
+#endif
+
+#define VARIANT (MALLOC_TLSF ? "tlsf" : MALLOC_RELEASE ? "release" : "debug")
+
+#define TRACE_IDS 256
+#define TRACE_OPS 8192
+#define BENCH_PASSES 200
+
+/**
+ * @implementation_details:
+ * a trace is read into memory first so the file I/O is not timed
+ */
+typedef struct {
+  uint8_t op;
+  uint8_t id;
+  uint16_t size;
+} trace_op_t;
+
+static trace_op_t trace[TRACE_OPS];
+static uint8_ptr_t blocks[TRACE_IDS];
+
+/**
+ * @function:
+ * load_trace
+ * @return: the number of operations read, -1 if the file can not be read
+ */
+static int load_trace(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == 0) {
+    return -1;
+  }
+  char line[64];
+  int count = 0;
+  while (fgets(line, sizeof(line), file) != 0 && count < TRACE_OPS) {
+    char op;
+    unsigned id;
+    unsigned size = 0;
+    if (line[0] == '#' || sscanf(line, " %c %u %u", &op, &id, &size) < 2 ||
+        id >= TRACE_IDS) {
+      continue;
+    }
+    trace[count].op = op;
+    trace[count].id = id;
+    trace[count].size = size;
+    count++;
+  }
+  fclose(file);
+  return count;
+}
+
+/**
+ * @function:
+ * heap_used
+ * @return: bytes between __HEAP_START and the given end, heap_stats reports
+ * 16 bit addresses
+ */
+static uint16_t heap_used(uint16_t end) {
+  extern uint8_t __HEAP_START[];
+  return end - (uint16_t)(unsigned long)__HEAP_START;
+}
+
+/**
+ * @function:
+ * file_name
+ * @return: path without its directories
+ */
+static const char *file_name(const char *path) {
+  const char *name = path;
+  for (const char *character = path; *character != '\0'; character++) {
+    if (*character == '/') {
+      name = character + 1;
+    }
+  }
+  return name;
+}
+
+static void replay(const char *path, int count) {
+  long failed = 0;
+  uint8_t max_fragmentation = 0;
+  uint8_t end_fragmentation = 0;
+  uint16_t peak = 0;
+  heap_stats_t stats;
+  clock_t start = clock();
+  for (int pass = 0; pass < BENCH_PASSES; pass++) {
+    for (int index = 0; index < count; index++) {
+      trace_op_t *op = &trace[index];
+      int result = 0;
+      switch (op->op) {
+      case 'm':
+        result = blocks[op->id] == 0 ? malloc(op->size, &blocks[op->id], 0)
+                                     : -1;
+        break;
+      case 'c':
+        result = blocks[op->id] == 0
+                     ? calloc(1, op->size, &blocks[op->id], 0)
+                     : -1;
+        break;
+      case 'r':
+        result = realloc(&blocks[op->id], op->size, 0);
+        break;
+      case 'f':
+        result = blocks[op->id] != 0 ? free(blocks[op->id]) : -1;
+        blocks[op->id] = 0;
+        break;
+      }
+      if (result != 0) {
+        failed++;
+      }
+      // sampled on the first pass only, every pass does the same
+      if (pass == 0) {
+        heap_stats(&stats);
+        if (stats.fragmentation > max_fragmentation) {
+          max_fragmentation = stats.fragmentation;
+        }
+        if (heap_used(stats.heap_end) > peak) {
+          peak = heap_used(stats.heap_end);
+        }
+      }
+    }
+    if (pass == 0) {
+      end_fragmentation = heap_fragmentation();
+    }
+    for (int id = 0; id < TRACE_IDS; id++) {
+      if (blocks[id] != 0) {
+        free(blocks[id]);
+        blocks[id] = 0;
+      }
+    }
+  }
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  long ops = (long)count * BENCH_PASSES;
+  printf("%-24s %8ld %10.0f %7ld %5u %9u%% %8u%%\n", file_name(path), ops,
+         seconds > 0 ? ops / seconds : 0, failed / BENCH_PASSES,
+         peak, max_fragmentation, end_fragmentation);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("usage: %s <trace>...\n", argv[0]);
+    return 1;
+  }
+  printf("malloc.c %s variant, %d passes per trace\n",
+         VARIANT, BENCH_PASSES);
+  printf("%-24s %8s %10s %7s %5s %10s %9s\n", "trace", "ops", "ops/sec",
+         "failed", "peak", "max frag", "end frag");
+  for (int arg = 1; arg < argc; arg++) {
+    int count = load_trace(argv[arg]);
+    if (count < 0) {
+      printf("%s: can not read the trace\n", argv[arg]);
+      return 1;
+    }
+    replay(argv[arg], count);
+  }
+  return 0;
+}
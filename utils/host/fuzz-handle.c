@@ -0,0 +1,333 @@
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * Randomized fuzzer for handle.c on the host. It runs random handle_alloc,
+ * handle_free, handle_lock, handle_unlock and handle_compact calls, and the
+ * calls that must be rejected, against relocatable heaps of several shapes
+ * and checks the whole heap after every single operation:
+ *
+ * ./fuzz-handle [operations] [seed]
+ *
+ * On the first broken invariant it prints the operation and the invariant
+ * and exits with 1.
+ *
+ * @implementation_details:
+ * handle.c is included instead of linked so the checks can read ERNO, the
+ * handle table and the block headers.
+ *
+ * Invariants:
+ * 1. the blocks tile the heap from data to exactly top, top stays below end
+ * 2. the table entry of every allocated handle points to a block of that
+ *    handle with at least the requested size, every other block is free, the
+ *    lock count in the header is the number of locks taken
+ * 3. every allocated block keeps the pattern the fuzzer wrote into it, across
+ *    every compaction
+ * 4. a locked block stays at the address it had when it was locked
+ * 5. handle_alloc of handle_largest_free bytes succeeds without a compaction,
+ *    a larger request compacts first
+ * 6. a compaction with no block locked leaves no free block below top
+ * 7. a free of a locked block, a free or unlock of a handle that is not
+ *    allocated and an unlock of an unlocked block are rejected with their
+ *    error and change nothing
+ */
+
+#include <stdio.h>
+
+#include "../src/handle.c"
+
+// not <stdlib.h>, the host build renames malloc and free
+void exit(int status);
+long atol(const char *string);
+
+/**
+ * the shapes the fuzzer cycles through: a heap that holds one block, small
+ * heaps that run out of room all the time, large ones with many handles.
+ * Every other round starts the region on an odd address.
+ */
+typedef struct {
+  uint16_t size;
+  uint8_t handles;
+} shape_t;
+
+static const shape_t shapes[] = {{64, 1},     {64, 4},    {256, 16},
+                                 {700, 32},   {2048, 64}, {2048,
+                                                           HANDLE_MAX_COUNT}};
+#define SHAPES (sizeof(shapes) / sizeof(shapes[0]))
+#define OPERATIONS_PER_SHAPE 20000
+#define MAX_LOCKS 3
+
+static uint8_t memory[2048 + 1] __attribute__((aligned(2)));
+static handle_heap_t heap;
+static uint16_t region_size;
+
+// what the fuzzer expects of every handle
+static uint8_t allocated[HANDLE_MAX_COUNT];
+static uint16_t sizes[HANDLE_MAX_COUNT];
+static uint8_t seeds[HANDLE_MAX_COUNT];
+static uint8_t locks[HANDLE_MAX_COUNT];
+static uint8_ptr_t locked_at[HANDLE_MAX_COUNT];
+static long operation;
+
+/**
+ * @function:
+ * next_random
+ * @return: a pseudo random number (xorshift32), the same sequence for the
+ * same seed on every host
+ */
+static uint32_t random_state = 1;
+
+static uint16_t next_random() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  random_state &= 0xffffffff;
+  return (uint16_t)(random_state >> 8);
+}
+
+static void fail(const char *invariant, uint16_t handle) {
+  printf("operation %ld: %s (handle %u, region %u bytes, %u handles)\n",
+         operation, invariant, handle, region_size, heap.handles);
+  exit(1);
+}
+
+#define CHECK(condition, invariant, handle)                                    \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fail(invariant, handle);                                                 \
+    }                                                                          \
+  } while (0)
+
+static uint8_ptr_t block_of(handle_t handle) {
+  return heap.data + heap.table[handle];
+}
+
+static void fill(handle_t handle) {
+  uint8_ptr_t payload = block_of(handle) + HANDLE_BLOCK_OVERHEAD;
+  for (uint16_t index = 0; index < sizes[handle]; index++) {
+    payload[index] = (uint8_t)(seeds[handle] + index);
+  }
+}
+
+static uint8_t intact(handle_t handle) {
+  uint8_ptr_t payload = block_of(handle) + HANDLE_BLOCK_OVERHEAD;
+  for (uint16_t index = 0; index < sizes[handle]; index++) {
+    if (payload[index] != (uint8_t)(seeds[handle] + index)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static uint8_t any_locked() {
+  for (uint8_t handle = 0; handle < heap.handles; handle++) {
+    if (locks[handle] != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @function:
+ * check_heap
+ * @description:
+ * walk the blocks and the table and check invariants 1 - 4
+ */
+static void check_heap() {
+  CHECK(heap.data <= heap.top && heap.top <= heap.end, "top out of range", 0);
+  uint16_t owned = 0;
+  uint8_ptr_t block = heap.data;
+  while (block < heap.top) {
+    CHECK((header(block)->size & 1) == 0, "odd block size", 0);
+    CHECK(next_block(block) <= heap.top, "block crosses top", 0);
+    handle_t handle = header(block)->handle;
+    if (handle != HANDLE_NONE) {
+      CHECK(handle < heap.handles && allocated[handle], "block of no handle",
+            handle);
+      CHECK(block_of(handle) == block, "table does not point to the block",
+            handle);
+      owned++;
+    }
+    block = next_block(block);
+  }
+  CHECK(block == heap.top, "blocks do not end at top", 0);
+  uint16_t expected = 0;
+  for (uint8_t handle = 0; handle < heap.handles; handle++) {
+    if (!allocated[handle]) {
+      CHECK(heap.table[handle] == UNUSED_ENTRY, "free handle has a block",
+            handle);
+      continue;
+    }
+    expected++;
+    uint8_ptr_t own = block_of(handle);
+    CHECK(own >= heap.data && own < heap.top, "block outside the heap",
+          handle);
+    CHECK(header(own)->handle == handle, "block has another handle", handle);
+    CHECK(header(own)->size >= sizes[handle], "block too small", handle);
+    CHECK(header(own)->locks == locks[handle], "lock count", handle);
+    CHECK(intact(handle), "payload changed", handle);
+    if (locks[handle] != 0) {
+      CHECK(own == locked_at[handle], "locked block moved", handle);
+    }
+  }
+  CHECK(owned == expected, "blocks and handles do not match", 0);
+}
+
+static handle_t free_handle() {
+  for (uint8_t handle = 0; handle < heap.handles; handle++) {
+    if (!allocated[handle]) {
+      return handle;
+    }
+  }
+  return HANDLE_NONE;
+}
+
+/**
+ * @function:
+ * allocate
+ * @description:
+ * handle_alloc(size) and the model update. Checks invariant 5 against
+ * handle_largest_free right before the call.
+ */
+static void allocate(uint16_t size) {
+  uint16_t largest = handle_largest_free(&heap);
+  uint16_t compactions = heap.compactions;
+  handle_t expected = free_handle();
+  handle_t handle = HANDLE_NONE;
+  int result = handle_alloc(&heap, size, &handle);
+  if (expected == HANDLE_NONE) {
+    CHECK(result != 0 && ERNO == OUT_OF_HANDLES, "alloc without a free handle",
+          0);
+    return;
+  }
+  uint16_t rounded = (size + 1) & ~1;
+  if (rounded <= largest) {
+    CHECK(result == 0, "alloc of at most largest_free failed", 0);
+    CHECK(heap.compactions == compactions,
+          "alloc of at most largest_free compacted", 0);
+  } else {
+    CHECK(heap.compactions == compactions + 1,
+          "alloc above largest_free did not compact", 0);
+  }
+  if (result != 0) {
+    CHECK(ERNO == OUT_OF_MEMORY, "failed alloc reported the wrong error", 0);
+    return;
+  }
+  CHECK(handle == expected, "alloc did not take the first free handle",
+        handle);
+  allocated[handle] = 1;
+  sizes[handle] = size;
+  seeds[handle] = (uint8_t)next_random();
+  locks[handle] = 0;
+  fill(handle);
+}
+
+/**
+ * @function:
+ * reject
+ * @description:
+ * the call must fail with error and change nothing (invariant 7)
+ */
+static void reject(int result, enum ERRNO_VALUE error, uint8_ptr_t top,
+                   handle_t handle) {
+  CHECK(result != 0, "invalid call accepted", handle);
+  CHECK(ERNO == error, "invalid call reported the wrong error", handle);
+  CHECK(heap.top == top, "invalid call changed the heap", handle);
+}
+
+static void step() {
+  handle_t handle = next_random() % heap.handles;
+  uint16_t roll = next_random() % 32;
+  uint8_ptr_t top = heap.top;
+  if (roll < 10) {
+    // mostly small blocks, now and then one of up to half the region
+    uint16_t limit = (next_random() % 8 == 0) ? region_size / 2 : 24;
+    allocate(1 + next_random() % limit);
+  } else if (roll < 12) {
+    // exactly what largest_free promises, or just past it
+    uint16_t largest = handle_largest_free(&heap);
+    if (largest > 0) {
+      allocate(largest + (roll == 11 ? 1 : 0));
+    }
+  } else if (roll < 20) {
+    if (!allocated[handle]) {
+      reject(handle_free(&heap, handle), INVALID_HANDLE, top, handle);
+    } else if (locks[handle] != 0) {
+      reject(handle_free(&heap, handle), BLOCK_LOCKED, top, handle);
+    } else {
+      CHECK(handle_free(&heap, handle) == 0, "free failed", handle);
+      allocated[handle] = 0;
+    }
+  } else if (roll < 24) {
+    uint8_ptr_t ptr = 0x0000;
+    if (!allocated[handle]) {
+      reject(handle_lock(&heap, handle, &ptr), INVALID_HANDLE, top, handle);
+    } else if (locks[handle] < MAX_LOCKS) {
+      CHECK(handle_lock(&heap, handle, &ptr) == 0, "lock failed", handle);
+      CHECK(ptr == block_of(handle) + HANDLE_BLOCK_OVERHEAD,
+            "lock returned the wrong address", handle);
+      if (locks[handle] == 0) {
+        locked_at[handle] = block_of(handle);
+      }
+      locks[handle]++;
+    }
+  } else if (roll < 29) {
+    if (!allocated[handle]) {
+      reject(handle_unlock(&heap, handle), INVALID_HANDLE, top, handle);
+    } else if (locks[handle] == 0) {
+      reject(handle_unlock(&heap, handle), INVALID_LOCK, top, handle);
+    } else {
+      CHECK(handle_unlock(&heap, handle) == 0, "unlock failed", handle);
+      locks[handle]--;
+    }
+  } else {
+    handle_compact(&heap);
+    handle_compaction_t *result = handle_last_compaction(&heap);
+    CHECK(result->largest_after >= result->largest_before,
+          "compaction made the largest free area smaller", 0);
+    if (!any_locked()) {
+      // invariant 6
+      for (uint8_ptr_t block = heap.data; block < heap.top;
+           block = next_block(block)) {
+        CHECK(header(block)->handle != HANDLE_NONE,
+              "free block below top after compaction", 0);
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  long operations = argc > 1 ? atol(argv[1]) : 1000000;
+  random_state = argc > 2 ? (uint32_t)atol(argv[2]) : 1;
+  if (random_state == 0) {
+    random_state = 1;
+  }
+  CHECK(handle_heap_init(&heap, memory, 64, 0) != 0 && ERNO == INVALID_HEAP,
+        "handle_heap_init accepted 0 handles", 0);
+  CHECK(handle_heap_init(&heap, memory, 64, 33) != 0 && ERNO == INVALID_HEAP,
+        "handle_heap_init accepted a table larger than the region", 0);
+  for (operation = 0; operation < operations; operation++) {
+    long round = operation / OPERATIONS_PER_SHAPE;
+    if (operation % OPERATIONS_PER_SHAPE == 0) {
+      // a new shape, every handle is free again
+      const shape_t *shape = &shapes[round % SHAPES];
+      uint8_t odd = (round / SHAPES) & 1;
+      region_size = shape->size;
+      CHECK(handle_heap_init(&heap, memory + odd, region_size,
+                             shape->handles) == 0,
+            "handle_heap_init failed", 0);
+      CHECK(((uint16_t)heap.data & 1) == 0, "data is not 2 byte aligned", 0);
+      for (uint16_t handle = 0; handle < HANDLE_MAX_COUNT; handle++) {
+        allocated[handle] = 0;
+        locks[handle] = 0;
+      }
+    }
+    step();
+    check_heap();
+  }
+  printf("handle: %ld operations ok\n", operations);
+  return 0;
+}
@@ -0,0 +1,226 @@
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * Randomized fuzzer for pool.c on the host. It runs random pool_alloc and
+ * pool_free calls, double frees and frees of pointers that are not a slot of
+ * the pool against pools of several shapes and checks the whole pool after
+ * every single operation:
+ *
+ * ./fuzz-pool [operations] [seed]
+ *
+ * On the first broken invariant it prints the operation and the invariant
+ * and exits with 1.
+ *
+ * @implementation_details:
+ * pool.c is included instead of linked so the checks can read ERNO and the
+ * free list.
+ *
+ * Invariants:
+ * 1. pool_alloc fails only when every slot is held, with "Pool exhausted",
+ *    and hands out the start of a slot nobody holds
+ * 2. a double free and a pointer that is not the start of a slot of the pool
+ *    are rejected with their error and change nothing
+ * 3. the free list holds every free slot exactly once, the bitmap marks
+ *    exactly the held slots, pool_available counts the free ones
+ * 4. the held slots keep the pattern the fuzzer wrote into them
+ */
+
+#include <stdio.h>
+
+#include "../src/pool.c"
+
+// not <stdlib.h>, the host build renames malloc and free
+void exit(int status);
+long atol(const char *string);
+
+/**
+ * the shapes the fuzzer cycles through: slot sizes from 1 byte (only room
+ * for the free list link) up, slot counts up to POOL_MAX_SLOTS
+ */
+static const uint16_t slot_sizes[] = {1, 2, 3, 7, 32};
+static const uint8_t slot_counts[] = {1, 9, 64, POOL_MAX_SLOTS};
+#define SHAPES (sizeof(slot_sizes) / sizeof(slot_sizes[0]))
+#define COUNTS (sizeof(slot_counts) / sizeof(slot_counts[0]))
+#define OPERATIONS_PER_SHAPE 20000
+
+// one spare byte on each side, the foreign pointers just outside the region
+static uint8_t memory[POOL_REGION_SIZE(32, POOL_MAX_SLOTS) + 2];
+static uint8_t map[POOL_MAP_SIZE(POOL_MAX_SLOTS)];
+static pool_t pool;
+
+static uint8_t held[POOL_MAX_SLOTS];
+static uint8_t seeds[POOL_MAX_SLOTS];
+static long operation;
+
+/**
+ * @function:
+ * next_random
+ * @return: a pseudo random number (xorshift32), the same sequence for the
+ * same seed on every host
+ */
+static uint32_t random_state = 1;
+
+static uint16_t next_random() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  random_state &= 0xffffffff;
+  return (uint16_t)(random_state >> 8);
+}
+
+static void fail(const char *invariant, uint16_t slot) {
+  printf("operation %ld: %s (slot %u, slot size %u, %u slots)\n", operation,
+         invariant, slot, pool.slot_size, pool.count);
+  exit(1);
+}
+
+#define CHECK(condition, invariant, slot)                                      \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fail(invariant, slot);                                                   \
+    }                                                                          \
+  } while (0)
+
+static void fill(uint8_t slot) {
+  for (uint16_t index = 0; index < pool.slot_size; index++) {
+    slot_address(&pool, slot)[index] = (uint8_t)(seeds[slot] + index);
+  }
+}
+
+static uint8_t intact(uint8_t slot) {
+  for (uint16_t index = 0; index < pool.slot_size; index++) {
+    if (slot_address(&pool, slot)[index] != (uint8_t)(seeds[slot] + index)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @function:
+ * check_pool
+ * @description:
+ * walk the free list and the slots and check invariants 3 and 4
+ */
+static void check_pool() {
+  uint8_t seen[POOL_MAX_SLOTS] = {0};
+  uint16_t listed = 0;
+  for (uint8_t index = pool.free_head; index != POOL_END;
+       index = *slot_address(&pool, index)) {
+    CHECK(index < pool.count, "free list leaves the pool", index);
+    CHECK(!held[index], "free list holds a held slot", index);
+    CHECK(!seen[index], "free list has a cycle", index);
+    seen[index] = 1;
+    listed++;
+  }
+  uint16_t free_slots = 0;
+  for (uint8_t slot = 0; slot < pool.count; slot++) {
+    CHECK(((pool.map[slot >> 3] & map_bit(slot)) != 0) == held[slot],
+          "bitmap does not match", slot);
+    if (held[slot]) {
+      CHECK(intact(slot), "payload changed", slot);
+    } else {
+      CHECK(seen[slot], "free slot missing in the free list", slot);
+      free_slots++;
+    }
+  }
+  CHECK(listed == free_slots, "free list length", 0);
+  CHECK(pool_available(&pool) == free_slots, "pool_available", 0);
+}
+
+/**
+ * @function:
+ * reject
+ * @description:
+ * pool_free(ptr) must fail with error and change nothing (invariant 2)
+ */
+static void reject(uint8_ptr_t ptr, enum ERRNO_VALUE error, uint8_t slot) {
+  uint8_t available = pool_available(&pool);
+  uint8_t head = pool.free_head;
+  CHECK(pool_free(&pool, ptr) != 0, "invalid free accepted", slot);
+  CHECK(ERNO == error, "invalid free reported the wrong error", slot);
+  CHECK(pool_available(&pool) == available && pool.free_head == head,
+        "invalid free changed the pool", slot);
+}
+
+static void step() {
+  uint8_t slot = next_random() % pool.count;
+  uint16_t roll = next_random() % 16;
+  if (roll < 7) {
+    uint8_ptr_t ptr = 0x0000;
+    if (pool_available(&pool) == 0) {
+      CHECK(pool_alloc(&pool, &ptr) != 0, "alloc from a full pool", 0);
+      CHECK(ERNO == POOL_EXHAUSTED, "full pool reported the wrong error", 0);
+      return;
+    }
+    CHECK(pool_alloc(&pool, &ptr) == 0, "alloc failed", 0);
+    uint16_t offset = (uint16_t)(ptr - pool.region);
+    CHECK(ptr >= pool.region && offset % pool.slot_size == 0 &&
+              offset / pool.slot_size < pool.count,
+          "alloc returned no slot", 0);
+    uint8_t index = offset / pool.slot_size;
+    CHECK(!held[index], "alloc returned a held slot", index);
+    held[index] = 1;
+    seeds[index] = (uint8_t)next_random();
+    fill(index);
+  } else if (roll < 13) {
+    if (held[slot]) {
+      CHECK(pool_free(&pool, slot_address(&pool, slot)) == 0, "free failed",
+            slot);
+      held[slot] = 0;
+    } else {
+      reject(slot_address(&pool, slot), DOUBLE_FREE, slot);
+    }
+  } else if (roll == 13) {
+    // inside a slot, not at its start
+    if (pool.slot_size > 1) {
+      uint16_t inside = 1 + next_random() % (pool.slot_size - 1);
+      reject(slot_address(&pool, slot) + inside, ATTEMPTED_FREE_FOREIGN_SLOT,
+             slot);
+    }
+  } else if (roll == 14) {
+    // right before and right after the region
+    reject(pool.region - 1, ATTEMPTED_FREE_FOREIGN_SLOT, slot);
+    reject(slot_address(&pool, pool.count - 1) + pool.slot_size,
+           ATTEMPTED_FREE_FOREIGN_SLOT, slot);
+  } else {
+    // free and free again at once
+    if (held[slot]) {
+      CHECK(pool_free(&pool, slot_address(&pool, slot)) == 0, "free failed",
+            slot);
+      held[slot] = 0;
+      reject(slot_address(&pool, slot), DOUBLE_FREE, slot);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  long operations = argc > 1 ? atol(argv[1]) : 1000000;
+  random_state = argc > 2 ? (uint32_t)atol(argv[2]) : 1;
+  if (random_state == 0) {
+    random_state = 1;
+  }
+  CHECK(pool_init(&pool, memory + 1, map, 0, 8) != 0 && ERNO == INVALID_POOL,
+        "pool_init accepted slot size 0", 0);
+  CHECK(pool_init(&pool, memory + 1, map, 8, 0) != 0 && ERNO == INVALID_POOL,
+        "pool_init accepted 0 slots", 0);
+  for (operation = 0; operation < operations; operation++) {
+    long round = operation / OPERATIONS_PER_SHAPE;
+    if (operation % OPERATIONS_PER_SHAPE == 0) {
+      // a new shape, every slot is free again
+      CHECK(pool_init(&pool, memory + 1, map, slot_sizes[round % SHAPES],
+                      slot_counts[(round / SHAPES) % COUNTS]) == 0,
+            "pool_init failed", 0);
+      for (uint16_t slot = 0; slot < POOL_MAX_SLOTS; slot++) {
+        held[slot] = 0;
+      }
+    }
+    step();
+    check_pool();
+  }
+  printf("pool: %ld operations ok\n", operations);
+  return 0;
+}
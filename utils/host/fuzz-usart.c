@@ -0,0 +1,393 @@
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * Randomized fuzzer for the receive ring of usart.c on the host. A stand-in
+ * for the receiver of USART0 delivers random bytes, some of them with a frame
+ * or parity error, and runs the receive interrupt while main has interrupts
+ * enabled. Main reads with usart0_available, usart0_read, usart0_read_until and
+ * usart0_rx_stats, and every result is checked against a model:
+ *
+ * ./fuzz-usart [operations] [seed]
+ *
+ * On the first broken invariant it prints the operation and the invariant
+ * and exits with 1. Built with FUZZ_IMAGE=1 (fuzz-usart-image) the executable
+ * defines __image_no_vectors like image.ld does: the interrupt never runs and
+ * the read functions have to poll the receiver themselves.
+ *
+ * @implementation_details:
+ * usart.c is included instead of linked so its registers can be host
+ * variables. The receiver holds 2 bytes like the hardware, a byte that arrives
+ * while it is full is lost and sets DOR0 on the last byte it holds. UCSR0A
+ * always shows RXC0 and the error flags of the oldest byte, reading UDR0 takes
+ * that byte out.
+ *
+ * Invariants:
+ * 1. usart0_read and usart0_read_until return the received bytes without an
+ *    error, in order, each once, as long as the ring had room for them
+ * 2. usart0_read_until takes a record up to and including the terminator, or
+ *    length bytes when no terminator is among them, else nothing
+ * 3. usart0_available counts the bytes in the ring
+ * 4. a byte with FE0 or UPE0 never reaches the ring and counts as a frame or
+ *    parity error, a byte with DOR0 counts as a data overrun, a byte that
+ *    finds the ring full counts as a ring overflow
+ * 5. usart0_rx_stats restores SREG, usart0_init empties the ring and clears
+ *    the counters, RXCIE0 is set exactly when there is a vector table
+ */
+
+#include <stdio.h>
+
+#include "types.h"
+
+// not <stdlib.h>, the host build renames malloc and free
+void exit(int status);
+long atol(const char *string);
+
+#ifndef FUZZ_IMAGE
+#define FUZZ_IMAGE 0
+#endif
+
+/**
+ * the USART0 registers of avr-arch.h (the host shim has none of them). UDR0
+ * is read through host_udr0, which takes the oldest byte out of the receiver.
+ */
+static uint8_t host_prr;
+static uint8_t host_ubrr0h;
+static uint8_t host_ubrr0l;
+static uint8_t host_ucsr0a;
+static uint8_t host_ucsr0b;
+static uint8_t host_ucsr0c;
+static uint8_t *host_udr0();
+#define PRR host_prr
+#define PRUSART0 1
+#define UBRR0H host_ubrr0h
+#define UBRR0L host_ubrr0l
+#define UCSR0A host_ucsr0a
+#define MPCM0 0
+#define U2X0 1
+#define UPE0 2
+#define DOR0 3
+#define FE0 4
+#define UDRE0 5
+#define TXC0 6
+#define RXC0 7
+#define UCSR0B host_ucsr0b
+#define TXEN0 3
+#define RXEN0 4
+#define UDRIE0 5
+#define RXCIE0 7
+#define UCSR0C host_ucsr0c
+#define UCSZ00 1
+#define USBS0 3
+#define UDR0 (*host_udr0())
+
+uint8_t host_sreg = 1 << SREG7;
+
+/**
+ * interrupt.h and progmem.h are AVR only (signal attribute, lpm). Their
+ * include guards keep them out, usart.c gets these instead.
+ */
+#define AVR_INTERRUPT_H
+#define ISR(vector) void vector(void)
+#define USART_RX_vect host_usart_rx_vect
+#define USART_UDRE_vect host_usart_udre_vect
+
+#define AVR_PROGMEM_H
+typedef const uint8_t *uint8_flash_ptr_t;
+#define pgm_read_byte_inc(ptr) (*(ptr)++)
+
+#include "../src/usart.c"
+
+#if FUZZ_IMAGE
+// what image.ld defines, after usart.c so polled() is not folded at compile
+// time
+uint8_t __image_no_vectors;
+#endif
+
+#define HARDWARE_BYTES 2
+#define TERMINATOR '\n'
+#define MAX_READ 40
+
+/**
+ * the receiver: bytes that arrived and were not read from UDR0 yet, oldest
+ * first, each with its UCSR0A error flags
+ */
+static uint8_t hardware_data[HARDWARE_BYTES];
+static uint8_t hardware_flags[HARDWARE_BYTES];
+static uint8_t hardware_count;
+static uint8_t host_udr0_value;
+
+// what the fuzzer expects of the ring and the counters
+static uint8_t model[USART0_RX_BUFFER_SIZE];
+static uint8_t model_count;
+static usart_rx_stats_t expected;
+static long operation;
+// over the whole run, expected is cleared by every usart0_init
+static long total_overruns;
+static long total_overflows;
+
+/**
+ * @function:
+ * next_random
+ * @return: a pseudo random number (xorshift32), the same sequence for the
+ * same seed on every host
+ */
+static uint32_t random_state = 1;
+
+static uint16_t next_random() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  random_state &= 0xffffffff;
+  return (uint16_t)(random_state >> 8);
+}
+
+static void fail(const char *invariant, uint16_t value) {
+  printf("operation %ld: %s (value %u, %u bytes in the ring, %s)\n",
+         operation, invariant, value, model_count,
+         FUZZ_IMAGE ? "polled" : "interrupt");
+  exit(1);
+}
+
+#define CHECK(condition, invariant, value)                                     \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fail(invariant, value);                                                  \
+    }                                                                          \
+  } while (0)
+
+/**
+ * @function:
+ * show_oldest
+ * @description:
+ * UCSR0A shows RXC0 and the flags of the oldest byte, UDRE0 is always set
+ */
+static void show_oldest() {
+  host_ucsr0a &= (1 << TXC0) | (1 << U2X0) | (1 << MPCM0);
+  host_ucsr0a |= 1 << UDRE0;
+  if (hardware_count > 0) {
+    host_ucsr0a |= (1 << RXC0) | hardware_flags[0];
+  }
+}
+
+static uint8_t *host_udr0() {
+  CHECK(hardware_count > 0, "UDR0 read with RXC0 clear", 0);
+  host_udr0_value = hardware_data[0];
+  hardware_count--;
+  for (uint8_t index = 0; index < hardware_count; index++) {
+    hardware_data[index] = hardware_data[index + 1];
+    hardware_flags[index] = hardware_flags[index + 1];
+  }
+  show_oldest();
+  return &host_udr0_value;
+}
+
+/**
+ * @function:
+ * model_receive
+ * @description:
+ * what receive must do with a byte of the receiver (invariant 4), the fuzzer
+ * applies it to the model before usart.c takes the byte
+ */
+static void model_receive(uint8_t index) {
+  uint8_t flags = hardware_flags[index];
+  if (flags & (1 << DOR0)) {
+    expected.data_overruns++;
+    total_overruns++;
+  }
+  if (flags & (1 << FE0)) {
+    expected.frame_errors++;
+  } else if (flags & (1 << UPE0)) {
+    expected.parity_errors++;
+  } else if (model_count == USART0_RX_BUFFER_SIZE) {
+    expected.ring_overflows++;
+    total_overflows++;
+  } else {
+    model[model_count++] = hardware_data[index];
+  }
+}
+
+/**
+ * @function:
+ * run_interrupt
+ * @description:
+ * the receive interrupt fires as long as RXC0 is set and RXCIE0 and the I bit
+ * allow it
+ */
+static void run_interrupt() {
+  while (hardware_count > 0 && (host_ucsr0b & (1 << RXCIE0)) &&
+         (host_sreg & (1 << SREG7))) {
+    model_receive(0);
+    host_usart_rx_vect();
+  }
+}
+
+/**
+ * @function:
+ * model_poll
+ * @description:
+ * without a vector table the read functions take what the receiver holds.
+ * Called right before them, they leave the receiver empty.
+ */
+static void model_poll() {
+  if (FUZZ_IMAGE) {
+    for (uint8_t index = 0; index < hardware_count; index++) {
+      model_receive(index);
+    }
+  }
+}
+
+static void arrive(uint8_t data, uint8_t flags) {
+  if (hardware_count == HARDWARE_BYTES) {
+    // the new byte is lost, DOR0 of the last byte held says so
+    hardware_flags[HARDWARE_BYTES - 1] |= 1 << DOR0;
+  } else {
+    hardware_data[hardware_count] = data;
+    hardware_flags[hardware_count] = flags;
+    hardware_count++;
+  }
+  show_oldest();
+  run_interrupt();
+}
+
+static void model_take(uint8_t count) {
+  for (uint8_t index = count; index < model_count; index++) {
+    model[index - count] = model[index];
+  }
+  model_count -= count;
+}
+
+/**
+ * @function:
+ * check_read
+ * @description:
+ * the bytes a read returned are the oldest of the model (invariant 1)
+ */
+static void check_read(const uint8_t *buffer, uint8_t count, uint8_t expect) {
+  CHECK(count == expect, "read returned the wrong count", count);
+  for (uint8_t index = 0; index < count; index++) {
+    CHECK(buffer[index] == model[index], "read returned the wrong byte",
+          index);
+  }
+  model_take(count);
+}
+
+static void check_stats() {
+  usart_rx_stats_t stats;
+  uint8_t sreg = host_sreg;
+  usart0_rx_stats(&stats);
+  CHECK(host_sreg == sreg, "rx_stats did not restore SREG", host_sreg);
+  CHECK(stats.frame_errors == expected.frame_errors, "frame errors",
+        stats.frame_errors);
+  CHECK(stats.data_overruns == expected.data_overruns, "data overruns",
+        stats.data_overruns);
+  CHECK(stats.parity_errors == expected.parity_errors, "parity errors",
+        stats.parity_errors);
+  CHECK(stats.ring_overflows == expected.ring_overflows, "ring overflows",
+        stats.ring_overflows);
+}
+
+/**
+ * @function:
+ * initialize
+ * @description:
+ * usart0_init and the model update, checks invariant 5
+ */
+static void initialize() {
+  // UBRR0 for 16 MHz, 9600 baud
+  usart0_init(103);
+  model_count = 0;
+  expected.frame_errors = 0;
+  expected.data_overruns = 0;
+  expected.parity_errors = 0;
+  expected.ring_overflows = 0;
+  CHECK((host_ucsr0b & ((1 << TXEN0) | (1 << RXEN0))) ==
+            ((1 << TXEN0) | (1 << RXEN0)),
+        "transmitter or receiver off", host_ucsr0b);
+  CHECK(((host_ucsr0b & (1 << RXCIE0)) != 0) == !FUZZ_IMAGE,
+        "RXCIE0 does not match the vector table", host_ucsr0b);
+  // bytes the receiver held across usart0_init go into the new ring
+  model_poll();
+  CHECK(usart0_available() == model_count, "init left bytes in the ring",
+        model_count);
+  run_interrupt();
+}
+
+static void step() {
+  uint16_t roll = next_random() % 32;
+  uint8_t buffer[MAX_READ];
+  if (roll < 12) {
+    // a burst of bytes, now and then one with a frame or parity error
+    uint8_t burst = 1 + next_random() % 3;
+    for (uint8_t index = 0; index < burst; index++) {
+      uint8_t data = (next_random() % 32 == 0) ? TERMINATOR : next_random();
+      uint8_t flags = 0;
+      uint16_t error = next_random() % 64;
+      if (error == 0) {
+        flags = 1 << FE0;
+      } else if (error == 1) {
+        flags = 1 << UPE0;
+      } else if (error == 2) {
+        flags = (1 << FE0) | (1 << UPE0);
+      }
+      arrive(data, flags);
+    }
+  } else if (roll < 14) {
+    // main disables or enables interrupts, a long section with them off
+    // makes the receiver overrun
+    host_sreg ^= 1 << SREG7;
+    run_interrupt();
+  } else if (roll < 20) {
+    // mostly a few bytes, main falls behind and the ring fills up
+    uint8_t length =
+        (next_random() % 4 == 0) ? next_random() % MAX_READ : next_random() % 3;
+    model_poll();
+    uint8_t expect = model_count < length ? model_count : length;
+    check_read(buffer, usart0_read(buffer, length), expect);
+  } else if (roll < 26) {
+    // mostly longer than the ring, only a terminator ends the record
+    uint8_t length = (next_random() % 4 == 0) ? 1 + next_random() % MAX_READ
+                                              : MAX_READ;
+    model_poll();
+    // invariant 2
+    uint8_t visible = model_count < length ? model_count : length;
+    uint8_t expect = 0;
+    for (uint8_t index = 0; index < visible; index++) {
+      if (model[index] == TERMINATOR) {
+        expect = index + 1;
+        break;
+      }
+    }
+    if (expect == 0 && model_count >= length) {
+      expect = length;
+    }
+    check_read(buffer, usart0_read_until(buffer, length, TERMINATOR), expect);
+  } else if (roll < 29) {
+    model_poll();
+    CHECK(usart0_available() == model_count, "available", usart0_available());
+  } else if (roll < 31) {
+    check_stats();
+  } else if (next_random() % 8 == 0) {
+    initialize();
+  }
+}
+
+int main(int argc, char **argv) {
+  long operations = argc > 1 ? atol(argv[1]) : 1000000;
+  random_state = argc > 2 ? (uint32_t)atol(argv[2]) : 1;
+  if (random_state == 0) {
+    random_state = 1;
+  }
+  show_oldest();
+  initialize();
+  for (operation = 0; operation < operations; operation++) {
+    step();
+  }
+  check_stats();
+  printf("usart %s: %ld operations ok, %ld overruns, %ld ring overflows\n",
+         FUZZ_IMAGE ? "polled" : "interrupt", operations, total_overruns,
+         total_overflows);
+  return 0;
+}
@@ -0,0 +1,369 @@
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * Randomized fuzzer for malloc.c on the host. It runs random malloc, calloc,
+ * realloc and free calls (and some invalid frees) against the simulated SRAM
+ * and checks the whole heap after every single operation:
+ *
+ * ./fuzz [operations] [seed]
+ *
+ * On the first broken invariant it prints the operation, the invariant and
+ * the block map (heap_dump) and exits with 1.
+ *
+ * @implementation_details:
+ * malloc.c is included instead of linked so the checks can read its private
+ * state (__HEAP_END, the free lists, the counters) and use its helpers. The
+ * makefile builds this file once per allocator variant.
+ *
+ * Invariants:
+ * 1. the blocks tile the heap from __HEAP_START to exactly __HEAP_END
+ * 2. every capacity is in range and has the parity of the variant, every
+ *    header carries the magic number (debug)
+ * 3. an allocated block has an intact guard byte (debug) and the pattern the
+ *    fuzzer wrote into it
+ * 4. a free block has a footer equal to its capacity, is never the last
+ *    block and is next to another free block only when the two together
+ *    would pass MAX_CAPACITY
+ * 5. PREV_FREE is set exactly when the block before is free
+ * 6. the free lists are well linked (prev links match), only hold free blocks
+ *    of their size class and hold every free block, the TLSF bitmaps mark
+ *    exactly the non-empty lists
+ * 7. the counters of heap_stats match the heap, the canary is intact. A
+ *    request of largest_free succeeds when the top of the heap provides it,
+ *    a request one byte larger never does.
+ * 8. (MALLOC_ISR_SAFE) interrupts are enabled again after every call and
+ *    disabled after a call made with them disabled, the ISR reserve counts
+ *    the slots the fuzzer holds
+ */
+
+#include <stdio.h>
+
+#include "../src/malloc.c"
+
+// not <stdlib.h>, it declares the malloc and free of the C library
+void exit(int status);
+long atol(const char *string);
+
+#define FUZZ_SLOTS 48
+
+/**
+ * the largest request random_size makes. The 8K build raises it so free
+ * blocks grow past MAX_CAPACITY.
+ */
+#ifndef FUZZ_LARGE_SIZE
+#define FUZZ_LARGE_SIZE 600
+#endif
+
+#ifndef VARIANT
+#define VARIANT                                                                \
+  (MALLOC_ISR_SAFE ? "isr"                                                     \
+   : MALLOC_TLSF   ? "tlsf"                                                    \
+   : MALLOC_RELEASE ? "release"                                                \
+                    : "debug")
+#endif
+
+static uint8_ptr_t slots[FUZZ_SLOTS];
+static uint16_t sizes[FUZZ_SLOTS];
+static uint8_t seeds[FUZZ_SLOTS];
+static long operation;
+
+/**
+ * @function:
+ * next_random
+ * @return: a pseudo random number (xorshift32), the same sequence for the
+ * same seed on every host
+ */
+static uint32_t random_state = 1;
+
+static uint16_t next_random() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  // uint32_t is an unsigned long, 64 bits on most hosts
+  random_state &= 0xffffffff;
+  return (uint16_t)(random_state >> 8);
+}
+
+/**
+ * @function:
+ * fail
+ * @description:
+ * report a broken invariant and stop
+ */
+static void fail(const char *invariant, uint8_ptr_t ptr) {
+  printf("operation %ld: %s (block %u)\n", operation, invariant,
+         (unsigned)(ptr - __HEAP_START));
+  heap_dump();
+  exit(1);
+}
+
+#define CHECK(condition, invariant, ptr)                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fail(invariant, ptr);                                                    \
+    }                                                                          \
+  } while (0)
+
+/**
+ * @function:
+ * fill / intact
+ * @description:
+ * write a pattern derived from the slot into a block, and check it is still
+ * there
+ */
+static void fill(uint8_t slot) {
+  for (uint16_t index = 0; index < sizes[slot]; index++) {
+    slots[slot][index] = (uint8_t)(seeds[slot] + index);
+  }
+}
+
+static uint8_t intact(uint8_t slot) {
+  for (uint16_t index = 0; index < sizes[slot]; index++) {
+    if (slots[slot][index] != (uint8_t)(seeds[slot] + index)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @function:
+ * check_heap
+ * @description:
+ * walk the heap and the free lists and check every invariant
+ */
+static void check_heap() {
+  uint16_t walked_free_blocks = 0;
+  uint16_t walked_free_bytes = 0;
+  uint16_t walked_used_blocks = 0;
+  uint16_t walked_used_bytes = 0;
+  uint8_t previous_free = 0;
+  uint16_t previous_capacity = 0;
+  uint8_ptr_t ptr = __HEAP_START + 2;
+
+  CHECK(canary() == HEAP_CANARY, "canary overwritten", ptr);
+#if MALLOC_ISR_SAFE
+  CHECK(SREG & (1 << SREG7), "interrupts left disabled", ptr);
+  uint8_t reserved = 0;
+#endif
+
+  // 1 - 5
+  while (ptr - 2 < __HEAP_END) {
+    uint16_t header = *(uint16_ptr_t)(ptr - 2);
+    uint16_t capacity = block_size(ptr);
+    CHECK(capacity >= MIN_CAPACITY && capacity <= MAX_CAPACITY,
+          "capacity out of range", ptr);
+    CHECK((capacity & 1) == (MALLOC_RELEASE ? 0 : 1), "capacity parity",
+          ptr);
+    CHECK((header & ALLOCATED_MASK) == HEADER_MAGIC, "header magic", ptr);
+    CHECK(((header & PREV_FREE_MASK) != 0) == previous_free,
+          "PREV_FREE does not match the previous block", ptr);
+    CHECK(jump_to_next_block(ptr) - 2 <= __HEAP_END,
+          "block crosses __HEAP_END", ptr);
+    if (active_block(ptr)) {
+#if !MALLOC_RELEASE
+      CHECK(*(ptr + capacity) == MAGIC_NUMBER, "guard byte", ptr);
+#endif
+      walked_used_blocks++;
+      walked_used_bytes += capacity;
+      previous_free = 0;
+    } else {
+      CHECK(!previous_free ||
+                previous_capacity + BLOCK_OVERHEAD + capacity > MAX_CAPACITY,
+            "two free blocks next to each other", ptr);
+      CHECK(*(uint16_ptr_t)(ptr + capacity + GUARD_BYTES - 2) == capacity,
+            "footer", ptr);
+      CHECK(jump_to_next_block(ptr) - 2 < __HEAP_END,
+            "free block at the top of the heap", ptr);
+      walked_free_blocks++;
+      walked_free_bytes += capacity;
+      previous_free = 1;
+    }
+    previous_capacity = capacity;
+    ptr = jump_to_next_block(ptr);
+  }
+  CHECK(ptr - 2 == __HEAP_END, "blocks do not end at __HEAP_END", ptr);
+  CHECK(__HEAP_END <= __HEAP_LIMIT, "__HEAP_END above __HEAP_LIMIT", ptr);
+
+  // 6
+  uint16_t listed_blocks = 0;
+  for (uint8_t bucket = 0; bucket < BUCKETS; bucket++) {
+    uint16_t previous = 0;
+    for (uint16_t offset = free_lists[bucket]; offset != 0;
+         offset = *next_link(offset_block(offset))) {
+      uint8_ptr_t block = offset_block(offset);
+      CHECK(block - 2 < __HEAP_END && !active_block(block),
+            "list holds a block that is not free", block);
+      CHECK(size_class(block_size(block)) == bucket, "block in wrong list",
+            block);
+      CHECK(*prev_link(block) == previous, "prev link", block);
+      CHECK(++listed_blocks <= walked_free_blocks, "list has a cycle", block);
+      previous = offset;
+    }
+  }
+  CHECK(listed_blocks == walked_free_blocks, "free block missing in lists",
+        ptr);
+#if MALLOC_TLSF
+  for (uint8_t bucket = 0; bucket < BUCKETS; bucket++) {
+    uint8_t first = bucket / SL_COUNT;
+    CHECK(((sl_bitmap[first] >> (bucket % SL_COUNT)) & 1) ==
+              (free_lists[bucket] != 0),
+          "sl_bitmap does not match the list", ptr);
+    CHECK(((fl_bitmap >> first) & 1) == (sl_bitmap[first] != 0),
+          "fl_bitmap does not match sl_bitmap", ptr);
+  }
+#endif
+
+  // 7
+  CHECK(walked_free_blocks == free_blocks && walked_free_bytes == free_bytes,
+        "free counters", ptr);
+  CHECK(walked_used_blocks == used_blocks && walked_used_bytes == used_bytes,
+        "used counters", ptr);
+
+  for (uint8_t slot = 0; slot < FUZZ_SLOTS; slot++) {
+#if MALLOC_ISR_SAFE
+    if (slots[slot] != 0 && reserve_block(slots[slot])) {
+      reserved++;
+      CHECK(sizes[slot] <= MALLOC_ISR_RESERVE_SIZE, "reserve slot too small",
+            slots[slot]);
+      CHECK(intact(slot), "payload changed", slots[slot]);
+      continue;
+    }
+#endif
+    if (slots[slot] != 0) {
+      CHECK(active_block(slots[slot]), "live block is not active",
+            slots[slot]);
+      CHECK(block_size(slots[slot]) >= sizes[slot], "block too small",
+            slots[slot]);
+      CHECK(intact(slot), "payload changed", slots[slot]);
+    }
+  }
+#if MALLOC_ISR_SAFE
+  CHECK(reserved + heap_isr_reserve_available() == MALLOC_ISR_RESERVE_SLOTS,
+        "ISR reserve count", ptr);
+#endif
+}
+
+/**
+ * @function:
+ * check_largest_free
+ * @description:
+ * invariant 7 for largest_free of heap_stats. Allocates and frees again, the
+ * heap ends up the same.
+ */
+static void check_largest_free() {
+  heap_stats_t stats;
+  heap_stats(&stats);
+  uint8_ptr_t block = 0x0000;
+  uint8_ptr_t end = __HEAP_END;
+  if (stats.largest_free > 0 && top_capacity() >= largest_free_block()) {
+    CHECK(malloc(stats.largest_free, &block, 0) == 0,
+          "largest_free does not fit the top of the heap", end);
+    CHECK(free(block) == 0, "free failed", block);
+    CHECK(__HEAP_END == end, "largest_free changed the heap", end);
+    block = 0x0000;
+  }
+  if (stats.largest_free < MAX_CAPACITY) {
+    CHECK(malloc(stats.largest_free + 1, &block, 0) != 0,
+          "a request above largest_free succeeded", block);
+  }
+}
+
+/**
+ * @function:
+ * random_size
+ * @return: mostly small requests with some large ones, like a program that
+ * allocates messages and the occasional buffer
+ */
+static uint16_t random_size() {
+  uint16_t roll = next_random() % 16;
+  if (roll < 11) {
+    return 1 + next_random() % 24;
+  } else if (roll < 15) {
+    return 1 + next_random() % 128;
+  }
+  return 1 + next_random() % FUZZ_LARGE_SIZE;
+}
+
+static void step() {
+  uint8_t slot = next_random() % FUZZ_SLOTS;
+  uint16_t roll = next_random() % 16;
+  if (slots[slot] == 0) {
+    uint16_t size = random_size();
+    int result;
+#if MALLOC_ISR_SAFE
+    if (roll == 11) {
+      // as an interrupt handler would, with the I bit clear
+      cli();
+      result = malloc_from_isr(size, &slots[slot], 0);
+      CHECK((SREG & (1 << SREG7)) == 0, "malloc_from_isr enabled interrupts",
+            slots[slot]);
+      sei();
+    } else
+#endif
+      result = roll < 12 ? malloc(size, &slots[slot], 0)
+                         : calloc(1, size, &slots[slot], 0);
+    if (result == 0) {
+      if (roll >= 12) {
+        for (uint16_t index = 0; index < size; index++) {
+          CHECK(slots[slot][index] == 0, "calloc block not zero",
+                slots[slot]);
+        }
+      }
+      sizes[slot] = size;
+      seeds[slot] = (uint8_t)next_random();
+      fill(slot);
+    } else {
+      CHECK(slots[slot] == 0, "failed malloc changed the pointer", 0);
+    }
+  } else if (roll < 7) {
+    CHECK(free(slots[slot]) == 0, "free failed", slots[slot]);
+    slots[slot] = 0;
+  } else if (roll < 14) {
+    uint16_t size = random_size();
+    uint8_ptr_t before = slots[slot];
+    if (realloc(&slots[slot], size, 0) == 0) {
+      // the bytes both sizes have in common must survive
+      if (size < sizes[slot]) {
+        sizes[slot] = size;
+      }
+      CHECK(intact(slot), "realloc lost the content", slots[slot]);
+      sizes[slot] = size;
+      fill(slot);
+    } else {
+      CHECK(slots[slot] == before, "failed realloc moved the block", before);
+    }
+  } else if (roll == 14) {
+    // a pointer into the middle of a block is not a block
+    CHECK(free(slots[slot] + 1) != 0, "free accepted an odd pointer",
+          slots[slot]);
+  } else {
+    // double free, the block must stay intact
+    uint8_ptr_t block = slots[slot];
+    CHECK(free(block) == 0, "free failed", block);
+    slots[slot] = 0;
+    CHECK(free(block) != 0, "double free not detected", block);
+  }
+}
+
+int main(int argc, char **argv) {
+  long operations = argc > 1 ? atol(argv[1]) : 1000000;
+  random_state = argc > 2 ? (uint32_t)atol(argv[2]) : 1;
+  if (random_state == 0) {
+    random_state = 1;
+  }
+  for (operation = 0; operation < operations; operation++) {
+    step();
+    check_heap();
+    check_largest_free();
+  }
+  heap_stats_t stats;
+  heap_stats(&stats);
+  printf("%s: %ld operations ok, %u blocks in use, fragmentation %u%%\n",
+         VARIANT, operations, stats.used_blocks,
+         stats.fragmentation);
+  return 0;
+}
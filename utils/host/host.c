@@ -0,0 +1,54 @@
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * The parts of the microcontroller the allocator needs when it runs on the
+ * host: the SRAM, the registers of the avr-arch.h shim and usart0, which
+ * writes to stdout so heap_dump and heap_leak_report work unchanged.
+ */
+
+#include <stdio.h>
+
+#include "avr-arch.h"
+#include "malloc.h"
+#include "types.h"
+
+/**
+ * aligned like the real SRAM, __HEAP_START must be even
+ */
+uint8_t host_sram[HOST_SRAM_SIZE] __attribute__((aligned(2)));
+
+// the stack is empty, SP = RAMEND
+uint8_t host_sph = RAMEND >> 8;
+uint8_t host_spl = RAMEND & 0xff;
+
+// interrupts enabled, like a program after sei()
+uint8_t host_sreg = 1 << SREG7;
+
+/**
+ * crt.s writes the heap canary before main, so does this on the host
+ */
+extern uint8_t __HEAP_LIMIT[];
+
+__attribute__((constructor)) static void host_boot() {
+  *(uint16_t *)__HEAP_LIMIT = HEAP_CANARY;
+}
+
+void usart0_transmit_byte(uint8_t data) {
+  // the usart functions end their lines with \n\r
+  if (data != '\r') {
+    putchar(data);
+  }
+}
+
+void usart0_transmit_bytes(uint8_ptr_t ptr) { fputs((const char *)ptr, stdout); }
+
+void usart0_transmit_bytes_P(const uint8_t *ptr) {
+  fputs((const char *)ptr, stdout);
+}
+
+void usart0_transmit_uint16(uint16_t value) { printf("%u", value); }
+
+void usart0_transmit_hex16(uint16_t value) { printf("0x%04x", value); }
@@ -0,0 +1,57 @@
+#ifndef AVR_ARCH_H
+#define AVR_ARCH_H
+
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * Stand-in for utils/include/avr-arch.h when the allocator is built for the
+ * host (see the makefile in this directory). The registers the allocator
+ * touches are plain variables defined in host.c instead of memory mapped I/O.
+ * The makefile force-includes this file (-include) so it is always seen
+ * first. It uses the include guard of the real avr-arch.h, a header that
+ * includes "avr-arch.h" from utils/include later gets nothing.
+ **/
+
+#include "types.h"
+
+/**
+ * the simulated SRAM of the atmega328p (host.c). The makefile places
+ * __HEAP_START and __HEAP_LIMIT in it. A build for a larger MCU sets both
+ * with -D.
+ */
+#ifndef HOST_SRAM_SIZE
+#define HOST_SRAM_SIZE 2048
+#endif
+extern uint8_t host_sram[HOST_SRAM_SIZE];
+
+#ifndef RAMEND
+#define RAMEND 0x08FF
+#endif
+
+/**
+ * Stack Pointer
+ */
+extern uint8_t host_sph;
+extern uint8_t host_spl;
+#define SPH host_sph
+#define SPL host_spl
+
+/**
+ * Status Register
+ */
+extern uint8_t host_sreg;
+#define SREG host_sreg
+// global interrupt enable
+#define SREG7 7
+
+/**
+ * there are no interrupts on the host, only the I bit is kept up to date so
+ * code that saves and restores SREG behaves the same
+ */
+#define cli() (SREG &= ~(1 << SREG7))
+#define sei() (SREG |= (1 << SREG7))
+
+#endif // AVR_ARCH_H
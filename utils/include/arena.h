@@ -0,0 +1,156 @@
+#ifndef AVR_ARENA_H
+#define AVR_ARENA_H
+
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * This module will provide an arena (bump) allocator for scratch memory that
+ * is thrown away all at once, e.g. the temporary buffers of one pass through
+ * the main loop.
+ *
+ * @knowledge:
+ * An arena is a region of SRAM and a pointer to its first unused byte (the
+ * top). arena_alloc hands out the bytes at the top and moves the top up, that
+ * is all it does. There is no header and no free of a single object. Instead
+ * arena_mark remembers the top and arena_release(mark) moves the top back,
+ * which drops every allocation made after the mark in one step.
+ *
+ * arena_t scratch;
+ * arena_init_heap(&scratch, 256, __LINE__);
+ * while (1) {
+ *   arena_mark_t mark = arena_mark(&scratch);
+ *   arena_alloc(&scratch, 32, &frame);
+ *   arena_alloc(&scratch, 64, &reply);
+ *   ...
+ *   arena_release(&scratch, mark);
+ * }
+ *
+ * Marks nest: a function can take its own mark and release it before it
+ * returns without touching the allocations of its caller. A pointer into the
+ * arena is dangling after the mark it was allocated behind is released.
+ */
+
+#include "types.h"
+
+/**
+ * the state of one arena. Treat the fields as private.
+ */
+typedef struct {
+  // first byte of the region
+  uint8_ptr_t start;
+  // first unused byte
+  uint8_ptr_t top;
+  // first byte after the region
+  uint8_ptr_t end;
+  // 1 when the region is a malloc block (arena_init_heap)
+  uint8_t heap_block;
+} arena_t;
+
+/**
+ * a position in an arena, returned by arena_mark. It is the number of bytes
+ * in use when the mark was taken.
+ */
+typedef uint16_t arena_mark_t;
+
+/**
+ * @function:
+ * arena_init
+ *
+ * @purpose:
+ * set up an arena over a region the caller owns (a static array, an OVERLAY
+ * buffer). Allocations are 2 byte aligned, an odd region start loses a byte.
+ *
+ * @param arena: the arena to set up
+ * @param region: first byte of the region
+ * @param size: bytes in the region
+ */
+void arena_init(arena_t *arena, uint8_ptr_t region, uint16_t size);
+
+/**
+ * @function:
+ * arena_init_heap
+ *
+ * @purpose:
+ * set up an arena on top of one malloc block of size bytes. Give the block
+ * back with arena_destroy.
+ *
+ * @param line: passed on to malloc
+ * @return: 0 on success else -1 when malloc failed (see get_errno in malloc.h)
+ */
+int arena_init_heap(arena_t *arena, uint16_t size, uint16_t line);
+
+/**
+ * @function:
+ * arena_alloc
+ *
+ * @purpose:
+ * take size bytes from the top of the arena.
+ *
+ * @param ptr: receives the 2 byte aligned address of the bytes
+ * @return: 0 on success else -1 with "Arena full" in arena_get_errno
+ */
+int arena_alloc(arena_t *arena, uint16_t size, uint8_ptr_ptr_t ptr);
+
+/**
+ * @function:
+ * arena_mark
+ *
+ * @return: the current top of the arena, to pass to arena_release later
+ */
+arena_mark_t arena_mark(arena_t *arena);
+
+/**
+ * @function:
+ * arena_release
+ *
+ * @purpose:
+ * drop every allocation made since mark was taken.
+ *
+ * @return: 0 on success else -1 with "Invalid mark" in arena_get_errno when
+ * the top is already below the mark (an outer mark was released first).
+ */
+int arena_release(arena_t *arena, arena_mark_t mark);
+
+/**
+ * @function:
+ * arena_reset
+ *
+ * @purpose:
+ * drop every allocation, the same as releasing a mark taken right after init.
+ */
+void arena_reset(arena_t *arena);
+
+/**
+ * @function:
+ * arena_remaining
+ *
+ * @return: the number of bytes still free at the top of the arena
+ */
+uint16_t arena_remaining(arena_t *arena);
+
+/**
+ * @function:
+ * arena_destroy
+ *
+ * @purpose:
+ * free the malloc block of an arena set up with arena_init_heap. An arena over
+ * a caller owned region is only emptied.
+ *
+ * @return: the return value of free, 0 for a caller owned region
+ */
+int arena_destroy(arena_t *arena);
+
+/**
+ * @function:
+ * arena_get_errno
+ *
+ * @purpose:
+ * This function will return a string representation of the error that caused
+ * the last arena function to return -1.
+ */
+uint8_ptr_t arena_get_errno();
+
+#endif // AVR_ARENA_H
@@ -97,6 +97,18 @@
 // (call clobbered)
 #define R31 *(volatile uint8_t *)0x1F
 
+/**
+ * last address of SRAM. The stack pointer is set to this address by crt.s
+ * (RAMEND in common/mcu/<mcu>/mcu.inc, keep the two in sync)
+ */
+#if defined(__AVR_ATmega2560__)
+#define RAMEND 0x21FF
+#elif defined(__AVR_ATmega168__)
+#define RAMEND 0x04FF
+#else
+#define RAMEND 0x08FF
+#endif
+
 /**
  * Stack Pointer
  */
@@ -128,6 +140,62 @@
 // global interrupt enable
 #define SREG7 7
 
+/**
+ * disable / enable interrupts (clear / set SREG7). The memory clobber keeps the
+ * compiler from moving loads and stores across them.
+ */
+#define cli() asm volatile("cli" ::: "memory")
+#define sei() asm volatile("sei" ::: "memory")
+
+/**
+ * MCU Status Register
+ * tells us which source caused the last reset. A flag is only cleared by a
+ * power-on reset or by writing zero to it. crt.s saves and clears this register
+ * before main is called (see boot.h).
+ */
+#define MCUSR *(volatile uint8_t *)0x54
+// power-on reset flag
+#define PORF 0
+// external reset flag
+#define EXTRF 1
+// brown-out reset flag
+#define BORF 2
+// watchdog system reset flag
+#define WDRF 3
+
+/**
+ * Watchdog Timer Control Register
+ */
+#define WDTCSR *(volatile uint8_t *)0x60
+// watchdog timer prescaler
+#define WDP0 0
+#define WDP1 1
+#define WDP2 2
+// watchdog system reset enable
+#define WDE 3
+// watchdog change enable
+#define WDCE 4
+#define WDP3 5
+// watchdog interrupt enable
+#define WDIE 6
+// watchdog interrupt flag
+#define WDIF 7
+
+/**
+ * Timer/Counter1 (16-bit)
+ */
+// Timer/Counter1 Control Register A
+#define TCCR1A *(volatile uint8_t *)0x80
+// Timer/Counter1 Control Register B
+#define TCCR1B *(volatile uint8_t *)0x81
+// clock select, CS10 alone runs the timer at the CPU clock (no prescaling)
+#define CS10 0
+#define CS11 1
+#define CS12 2
+// Timer/Counter1 counter, read the low byte first (it latches the high byte)
+#define TCNT1L *(volatile uint8_t *)0x84
+#define TCNT1H *(volatile uint8_t *)0x85
+
 // External Interrupt Control Register A
 #define EICRA *(volatile uint8_t *)0x69
 #define ISC00 0
@@ -180,6 +248,7 @@
 // ensure USART0 is not powered down
 #define PRR *(volatile uint8_t *)0x64
 #define PRUSART0 1
+#define PRTIM1 3
 
 /**
  * USART I/O Data Register
@@ -0,0 +1,126 @@
+#ifndef AVR_BOOT_H
+#define AVR_BOOT_H
+
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * This module gives C code access to what crt.s found out and did before
+ * calling main: the cause of the last reset, the .noinit section and the boot
+ * profile (how many cycles each startup stage took).
+ */
+
+#include "avr-arch.h"
+#include "types.h"
+
+/**
+ * macro to place a variable in the .noinit section. crt.s never writes to this
+ * section (no copy from flash, no zeroing) so a variable placed here keeps its
+ * value across any reset other than power-on. After a power-on reset its value
+ * is garbage, so check boot_reset_by(PORF) before trusting it.
+ *
+ * uint16_t NOINIT reset_counter;
+ *
+ * @note: do not give a NOINIT variable an initializer, it would never be
+ * loaded.
+ */
+#define NOINIT __attribute__((section(".noinit")))
+
+/**
+ * defined in crt.s (in .noinit). It holds the content of MCUSR at reset, see
+ * PORF, EXTRF, BORF and WDRF in avr-arch.h.
+ */
+extern uint8_t __reset_cause;
+
+/**
+ * macro to check if the last reset came from the given source
+ *
+ * if (boot_reset_by(WDRF)) { ... }
+ */
+#define boot_reset_by(FLAG) ((__reset_cause & (1 << FLAG)) != 0)
+
+/**
+ * crt.s sets this bit in __reset_cause when it took the warm boot path, i.e.
+ * crt.o was built with CRT_WARM_BOOT=1 and the reset came from the watchdog or
+ * a brown-out. .data, .bss and .noinit then still hold their values from
+ * before the reset.
+ */
+#define BOOT_WARM 7
+
+/**
+ * macro to check if .data and .bss were initialized by crt.s for this boot
+ */
+#define boot_cold() (!boot_reset_by(BOOT_WARM))
+
+/**
+ * @boot_profile:
+ * when crt.o is built with `make BOOT_PROFILE=1` (in /common/) crt.s starts
+ * Timer1 at the CPU clock in __init and records TCNT1 at the end of each
+ * startup stage. The values are cycles since __init (cumulative). A stage that
+ * did not run (stack painting disabled, warm boot) reads 0. The record lives in
+ * .noinit so nothing in crt.s overwrites it after it is written.
+ */
+typedef struct {
+  // end of __load_data (.data copied from flash)
+  uint16_t load_data;
+  // end of __zero_bss
+  uint16_t zero_bss;
+  // end of __paint_stack (0 when stack painting is disabled)
+  uint16_t paint_stack;
+  // entry of __call_main, right before main is called
+  uint16_t call_main;
+} boot_profile_t;
+
+/**
+ * defined in crt.s when built with BOOT_PROFILE=1. Referencing it (or calling
+ * boot_profile_print, boot-profile.o) without profiling enabled is a link
+ * error.
+ */
+extern boot_profile_t __boot_profile;
+
+/**
+ * @function:
+ * boot_profile_print
+ *
+ * @purpose:
+ * transmit the boot profile over usart0, one line per stage with the
+ * cumulative cycle count and the cycles spent in that stage. usart0 must be
+ * initialized (usart0_init) before calling this.
+ */
+void boot_profile_print();
+
+/**
+ * @multi_image:
+ * a multi-image flash (loader.ld, image.ld in /common/) holds a loader and up
+ * to IMAGE_SLOTS independent images. The loader boots the slot in
+ * __image_select and falls back to the first valid slot. After a power-on
+ * reset it boots slot 0. __image_select is a .noinit byte so a running image
+ * can pick the image for the next reset, e.g. to try a new firmware in slot 1
+ * and come back to slot 0 on a power cycle.
+ */
+#define IMAGE_SLOTS 4
+
+/**
+ * defined in crt.s (CRT_MULTI_IMAGE) and at the same address by image.ld. It
+ * holds the slot of the running image.
+ */
+extern uint8_t __image_select;
+
+/**
+ * @function:
+ * boot_image_switch
+ *
+ * @purpose:
+ * select the image for the next reset and reset the microcontroller with the
+ * watchdog. Only meaningful in an image of a multi-image flash (boot-image.o,
+ * it needs __image_select). Does not return.
+ *
+ * @param slot:
+ * slot to boot (0 ... IMAGE_SLOTS - 1). A slot without a valid image falls
+ * back to the first valid one.
+ */
+void boot_image_switch(uint8_t slot);
+
+#endif // AVR_BOOT_H
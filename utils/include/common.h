@@ -33,6 +33,18 @@ uint16_t strlen(uint8_ptr_t str);
  */
 void str_copy(uint8_ptr_t dest, uint8_ptr_t src);
 
+/**
+ * @function:
+ * divide
+ * @arguments: dividend, divisor
+ * @return: uint16_t - dividend / divisor (rounded down)
+ * @description:
+ * 16 bit unsigned division by shift and subtract, always 16 iterations. We
+ * link with -nostdlib so the division routine of libgcc is not available and
+ * `/` on a variable does not link. divisor must not be 0.
+ */
+uint16_t divide(uint16_t dividend, uint16_t divisor);
+
 /**
  * Define some useful macros that operate on individual bits
  * in a register.
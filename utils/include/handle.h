@@ -0,0 +1,224 @@
+#ifndef AVR_HANDLE_H
+#define AVR_HANDLE_H
+
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * This module will provide a relocatable heap for programs that run for a long
+ * time. Callers do not keep pointers into it, they keep a handle and ask for
+ * the pointer only while they use the block. Because nobody else holds the
+ * address of an unused block, the heap can move blocks together (compaction)
+ * and turn the holes between them into one free area at the top.
+ *
+ * @knowledge:
+ * Any allocator that never moves a block can end up with enough free bytes for
+ * a request, spread over holes that are each too small (fragmentation). With 2K
+ * of SRAM and months of uptime that is only a question of time. A handle adds
+ * one level of indirection: a table maps the handle to the block, compaction
+ * moves the block and updates the table.
+ *
+ * handle_heap_t messages;
+ * uint8_t message_region[512];
+ * handle_t frame;
+ * uint8_ptr_t data;
+ *
+ * handle_heap_init(&messages, message_region, sizeof(message_region), 16);
+ * handle_alloc(&messages, 64, &frame);
+ * handle_lock(&messages, frame, &data);
+ * ... use data ...
+ * handle_unlock(&messages, frame);
+ * ... data may point somewhere else now, lock again to use the block ...
+ * handle_free(&messages, frame);
+ *
+ * A locked block stays where it is. Compaction moves the unlocked blocks
+ * around it, the space right below a locked block can stay a hole. Keep
+ * blocks locked for as short as possible.
+ *
+ * handle_alloc compacts on its own when no hole and not the top of the heap
+ * can serve a request, and tries again. handle_compact does it on demand, e.g.
+ * in the idle part of the main loop where the pause does not hurt.
+ */
+
+#include "types.h"
+
+/**
+ * a handle is the index of an entry in the handle table of the heap
+ */
+typedef uint8_t handle_t;
+#define HANDLE_MAX_COUNT 254
+#define HANDLE_NONE 0xff
+
+/**
+ * bytes each block costs on top of its payload (size, handle and lock count)
+ */
+#define HANDLE_BLOCK_OVERHEAD 4
+
+/**
+ * macro to size the region: count blocks of size bytes and their handles
+ */
+#define HANDLE_REGION_SIZE(size, count)                                        \
+  ((count) * (((size) + 1) / 2 * 2 + HANDLE_BLOCK_OVERHEAD + 2))
+
+/**
+ * what the last compaction did. The cost of a compaction is the copy of the
+ * bytes it moved, a few cycles per byte plus a constant per block.
+ */
+typedef struct {
+  // bytes and blocks copied to a new address
+  uint16_t bytes_moved;
+  uint8_t blocks_moved;
+  // bytes the free area at the top of the heap grew by
+  uint16_t reclaimed;
+  // payload of the largest request that fits, before and after
+  uint16_t largest_before;
+  uint16_t largest_after;
+} handle_compaction_t;
+
+/**
+ * the state of one relocatable heap. Treat the fields as private, read the
+ * compaction results with handle_last_compaction.
+ */
+typedef struct {
+  // one entry per handle: offset of the block from data, 0xffff while unused
+  uint16_ptr_t table;
+  // first block
+  uint8_ptr_t data;
+  // first byte after the last block
+  uint8_ptr_t top;
+  // first byte after the region
+  uint8_ptr_t end;
+  // number of entries in the table
+  uint8_t handles;
+  // number of compactions so far
+  uint16_t compactions;
+  handle_compaction_t last_compaction;
+} handle_heap_t;
+
+/**
+ * @function:
+ * handle_heap_init
+ *
+ * @purpose:
+ * set up a relocatable heap over a region the caller owns (a static array, an
+ * OVERLAY buffer or a malloc block). The first 2 * handles bytes hold the
+ * handle table, the blocks get the rest. An odd region start loses a byte.
+ *
+ * @param heap: the heap to set up
+ * @param region: first byte of the region
+ * @param size: bytes in the region
+ * @param handles: the most blocks the heap can hold at once (1 ...
+ * HANDLE_MAX_COUNT)
+ * @return: 0 on success else -1 (handles out of range or the table does not
+ * fit in the region)
+ */
+int handle_heap_init(handle_heap_t *heap, uint8_ptr_t region, uint16_t size,
+                     uint8_t handles);
+
+/**
+ * @function:
+ * handle_alloc
+ *
+ * @purpose:
+ * allocate a block of size bytes (rounded up to an even number). The block is
+ * unlocked, lock it to get its address. The content is undefined.
+ *
+ * @param handle: receives the handle of the block
+ * @return: 0 on success else -1 with the reason in handle_get_errno: no free
+ * handle, or not enough room even after a compaction.
+ */
+int handle_alloc(handle_heap_t *heap, uint16_t size, handle_t *handle);
+
+/**
+ * @function:
+ * handle_free
+ *
+ * @purpose:
+ * give the block of handle back. The handle can be handed out again.
+ *
+ * @return: 0 on success else -1: the handle is not allocated, or the block is
+ * still locked.
+ */
+int handle_free(handle_heap_t *heap, handle_t handle);
+
+/**
+ * @function:
+ * handle_lock
+ *
+ * @purpose:
+ * pin the block of handle and get its address. The address stays valid until
+ * the matching handle_unlock. Locks nest (up to 255), the block moves again
+ * when every lock is released.
+ *
+ * @param ptr: receives the first byte of the block, 2 byte aligned
+ * @return: 0 on success else -1 (handle not allocated, too many locks)
+ */
+int handle_lock(handle_heap_t *heap, handle_t handle, uint8_ptr_ptr_t ptr);
+
+/**
+ * @function:
+ * handle_unlock
+ *
+ * @purpose:
+ * release one lock of the block of handle. Pointers from handle_lock must not
+ * be used afterwards.
+ *
+ * @return: 0 on success else -1 (handle not allocated or not locked)
+ */
+int handle_unlock(handle_heap_t *heap, handle_t handle);
+
+/**
+ * @function:
+ * handle_compact
+ *
+ * @purpose:
+ * move every unlocked block as far down as it goes and merge the space freed
+ * above the last block into the free area at the top. The results are kept for
+ * handle_last_compaction.
+ */
+void handle_compact(handle_heap_t *heap);
+
+/**
+ * @function:
+ * handle_last_compaction
+ *
+ * @return: what the last compaction (from handle_alloc or handle_compact)
+ * did, all zero if there was none
+ */
+handle_compaction_t *handle_last_compaction(handle_heap_t *heap);
+
+/**
+ * @function:
+ * handle_largest_free
+ *
+ * @return: the largest size handle_alloc can serve right now without a
+ * compaction
+ */
+uint16_t handle_largest_free(handle_heap_t *heap);
+
+/**
+ * @function:
+ * handle_compaction_report
+ *
+ * @purpose:
+ * transmit the results of the last compaction over usart0. usart0 must be
+ * initialized.
+ *
+ * compaction 3: moved 5 blocks 212 bytes, reclaimed 96 bytes, largest free
+ * 40 -> 136
+ */
+void handle_compaction_report(handle_heap_t *heap);
+
+/**
+ * @function:
+ * handle_get_errno
+ *
+ * @purpose:
+ * This function will return a string representation of the error that caused
+ * the last handle function to return -1.
+ */
+uint8_ptr_t handle_get_errno();
+
+#endif // AVR_HANDLE_H
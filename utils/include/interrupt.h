@@ -14,8 +14,74 @@
 #include "types.h"
 
 /**
- * avr defined interrupt vectors
+ * avr defined interrupt vectors. The numbers differ between microcontrollers
+ * (datasheet, "Reset and Interrupt Vectors"), avr-gcc defines __AVR_<mcu>__ for
+ * the -mmcu we compile for. The atmega328p and atmega168 share one table.
  */
+#if defined(__AVR_ATmega2560__)
+#define INT0_vect __vector_1
+#define INT1_vect __vector_2
+#define INT2_vect __vector_3
+#define INT3_vect __vector_4
+#define INT4_vect __vector_5
+#define INT5_vect __vector_6
+#define INT6_vect __vector_7
+#define INT7_vect __vector_8
+#define PCINT0_vect __vector_9
+#define PCINT1_vect __vector_10
+#define PCINT2_vect __vector_11
+#define WDT_vect __vector_12
+#define TIMER2_COMPA_vect __vector_13
+#define TIMER2_COMPB_vect __vector_14
+#define TIMER2_OVF_vect __vector_15
+#define TIMER1_CAPT_vect __vector_16
+#define TIMER1_COMPA_vect __vector_17
+#define TIMER1_COMPB_vect __vector_18
+#define TIMER1_COMPC_vect __vector_19
+#define TIMER1_OVF_vect __vector_20
+#define TIMER0_COMPA_vect __vector_21
+#define TIMER0_COMPB_vect __vector_22
+#define TIMER0_OVF_vect __vector_23
+#define SPI_STC_vect __vector_24
+#define USART0_RX_vect __vector_25
+#define USART0_UDRE_vect __vector_26
+#define USART0_TX_vect __vector_27
+#define ANA_COMP_vect __vector_28
+#define ADC_vect __vector_29
+#define EE_RDY_vect __vector_30
+#define TIMER3_CAPT_vect __vector_31
+#define TIMER3_COMPA_vect __vector_32
+#define TIMER3_COMPB_vect __vector_33
+#define TIMER3_COMPC_vect __vector_34
+#define TIMER3_OVF_vect __vector_35
+#define USART1_RX_vect __vector_36
+#define USART1_UDRE_vect __vector_37
+#define USART1_TX_vect __vector_38
+#define TWI_vect __vector_39
+#define SPM_RDY_vect __vector_40
+#define TIMER4_CAPT_vect __vector_41
+#define TIMER4_COMPA_vect __vector_42
+#define TIMER4_COMPB_vect __vector_43
+#define TIMER4_COMPC_vect __vector_44
+#define TIMER4_OVF_vect __vector_45
+#define TIMER5_CAPT_vect __vector_46
+#define TIMER5_COMPA_vect __vector_47
+#define TIMER5_COMPB_vect __vector_48
+#define TIMER5_COMPC_vect __vector_49
+#define TIMER5_OVF_vect __vector_50
+#define USART2_RX_vect __vector_51
+#define USART2_UDRE_vect __vector_52
+#define USART2_TX_vect __vector_53
+#define USART3_RX_vect __vector_54
+#define USART3_UDRE_vect __vector_55
+#define USART3_TX_vect __vector_56
+/**
+ * usart.c drives USART0, give it the names used on the atmega328p
+ */
+#define USART_RX_vect USART0_RX_vect
+#define USART_UDRE_vect USART0_UDRE_vect
+#define USART_TX_vect USART0_TX_vect
+#else
 #define INT0_vect __vector_1
 #define INT1_vect __vector_2
 #define PCINT0_vect __vector_3
@@ -41,6 +107,7 @@
 #define ANA_COMP_vect __vector_23
 #define TWI_vect __vector_24
 #define SPM_RDY_vect __vector_25
+#endif
 
 /**
  * @macro:
@@ -52,8 +119,17 @@
  * @note:
  * you can read more about how this works by looking at crt.s and exploring weak
  * symbols with respect to the linker
+ *
+ * signal makes avr-gcc emit an interrupt prologue and epilogue for the
+ * handler: it saves SREG and every register the handler uses, clears r1 and
+ * returns with reti (which sets the I bit again) instead of ret. A plain
+ * function would corrupt the registers of the code it interrupted and return
+ * with interrupts disabled. used and externally_visible keep the compiler
+ * from dropping or renaming a handler that no C code calls.
  */
-#define ISR(vector) void vector(void)
+#define ISR(vector)                                                            \
+  void vector(void) __attribute__((signal, used, externally_visible));        \
+  void vector(void)
 
 /**
  * @function:
@@ -81,12 +81,100 @@
  * + size + 1) % 2) padding bytes.
  *
  * The `size` (an 11 bit value interpreted as an
- * uint16_t) is the number of bytes requested by the user (we can cover the
- * entire 2K SRAM in the microcontroller with 11 bits).
+ * uint16_t) is the capacity of the block: the number of bytes requested by the
+ * user rounded up to an odd number (at least 5), so the padding is folded into
+ * the payload and the buffer byte is always the last byte of an even sized
+ * block. A block reused from a free list keeps its capacity, which can be
+ * larger than the request. (we can cover the entire 2K SRAM in the
+ * microcontroller with 11 bits).
  *
  * The allocated flag is used to indicate if the block of
  * memory has been allocated or not. The padding size is used to ensure that
  * the payload is 2 byte aligned.
+ *
+ * @free_lists:
+ * A freed block is not searched for later. It is pushed on one of 11
+ * segregated free lists, one per power of two size class (class n holds the
+ * capacities [2^n, 2^(n + 1))). The list link lives in the first 2 bytes of
+ * the freed payload. malloc looks at the head of the class of the request and
+ * takes the head of the first non-empty list above it, every block there is
+ * big enough. Only when no list has a block the heap grows at __HEAP_END.
+ *
+ * The cost of malloc and free therefore does not depend on how many blocks are
+ * live or free: free is a constant number of steps plus size_class (at most 10
+ * shifts), malloc adds at most 11 list heads to look at. There is no loop over
+ * the blocks of the heap anywhere.
+ *
+ * @split_and_coalesce:
+ * malloc splits a free block that is at least 8 bytes larger than the request,
+ * the rest goes back on a free list. free merges the block with a free block
+ * right before and right after it (boundary tags: a free block repeats its
+ * size in its last 2 bytes and the reserved header bit of the following block
+ * is set while the block before it is free). A free block that ends at
+ * __HEAP_END is given back to the top of the heap. The lists are doubly linked
+ * so taking a neighbour off its list is constant time as well. A free block
+ * needs room for 2 links and the footer, the smallest capacity is 5.
+ */
+
+/**
+ * @release_variant:
+ * everything above describes the debug variant (malloc.o). The utils makefile
+ * also builds malloc-release.o from the same source with MALLOC_RELEASE=1.
+ * Link it instead of malloc.o for production, the functions and their
+ * signatures are the same:
+ *
+ * - there is no guard byte, a block costs 2 bytes on top of its capacity
+ *   instead of 3, and the capacity is rounded up to an even number (at least
+ *   6) instead of an odd one
+ * - the header has no magic number (bits 0 - 2 are 0) and free does not check
+ *   the magic number or the guard byte, an out of bounds write is not detected
+ * - free still rejects pointers outside the heap and double frees
+ *
+ * Link the two against the same program to compare the heap capacity (see
+ * heap_stats) and the cycles per call.
+ *
+ * @tlsf_variant:
+ * malloc-tlsf.o (MALLOC_TLSF=1, debug block layout) indexes the free blocks
+ * two-level segregated fit style: every power of two class is split again into
+ * 4 bins (36 lists) and two bitmaps record which lists hold a block. malloc
+ * rounds the request up to the next bin and finds the first non-empty bin at or
+ * above it with two bitmap lookups instead of looking at the list heads one by
+ * one. No step of malloc and free depends on the number of free blocks, the
+ * worst case has a bound that fragmentation can not raise. Requests are served
+ * from bins of their own size instead of the next power of two. The list heads
+ * and bitmaps take 83 bytes of .bss instead of 22.
+ *
+ * @worst_case:
+ * both variants have a fixed bound per call, counted in steps (a list
+ * operation is list_push or list_remove: a few loads and stores, a size_class
+ * and, with TLSF, the update of up to 2 bitmap bytes):
+ *
+ * - malloc.o: the size class of the request (at most 10 shifts), at most 11
+ *   list heads, then at most 2 list_remove and 1 list_push (the block taken
+ *   and, when it is split, the rest merged with the free block after it).
+ *   Every size_class is a loop of at most 10 shifts.
+ * - malloc-tlsf.o: 2 floor_log2 (4 fixed tests each), at most 2 bitmap
+ *   lookups (sl_bitmap of the bin of the request, else fl_bitmap and the
+ *   sl_bitmap of the level it finds, each resolved with one lowest_bit), no
+ *   list head is looked at, then the same 2 list_remove and 1 list_push.
+ * - free, both: the checks, at most 2 list_remove (the free neighbours before
+ *   and after) and 1 list_push, or giving the block back to the top of the
+ *   heap. On a heap larger than 2K (atmega2560) that also takes the free
+ *   blocks a skipped merge left before it off their lists, at most 1 per 1K
+ *   of heap.
+ *
+ * None of the counts grows with the number of live or free blocks.
+ *
+ * TLSF buys the tighter fit, not speed. Its bound does not need the scan of up
+ * to 11 list heads, but on AVR that scan is cheap and the shifts by a variable
+ * count TLSF needs (4 in the lookup, 1 per size_class, 2 per bitmap update,
+ * up to 9 positions each) are loops on AVR. A clang -Os build of the workload
+ * of examples/sram/malloc-benchmark took about 1.5 times the cycles with
+ * malloc-tlsf.o than with malloc.o, for malloc and free, worst case and
+ * average. Link malloc-tlsf.o when requests must be served from a bin close to
+ * their size (less of a large free block is split off for a small request),
+ * malloc.o otherwise. `make run` in that example prints the worst and the
+ * average cycles of both for the avr-gcc build you ship, measured in simavr.
  */
 
 /**
@@ -95,7 +183,9 @@
  * @param size: Size of the memory block, in bytes.
  * @return: On success a 2 byte aligned pointer to the memory block
  * allocated by the function else -1 if the function fails to allocate the
- * memory block.
+ * memory block. The heap never grows past __HEAP_LIMIT (see the SRAM budget in
+ * default.ld), a request that does not fit below it fails with
+ * "Memory allocation failed".
  */
 int malloc(uint16_t size, uint8_ptr_ptr_t ptr, uint16_t line);
 
@@ -105,9 +195,254 @@ int malloc(uint16_t size, uint8_ptr_ptr_t ptr, uint16_t line);
  * pointer, panic.
  *
  * @param ptr: Pointer to the memory block to be deallocated.
+ * @return: 0 on success else -1 with the reason in get_errno: ptr was not
+ * returned by malloc, the block is already free (double free), or the buffer
+ * byte behind the payload was overwritten (out of bounds write, the block is
+ * not freed).
  */
 int free(uint8_ptr_t ptr);
 
+/**
+ * @function:
+ * realloc: Changes the size of the memory block *ptr points to.
+ *
+ * @param ptr: in: a block returned by malloc (or 0, then this is malloc). out:
+ * the block, which may have moved.
+ * @param size: new size in bytes. 0 frees the block and sets *ptr to 0.
+ * @param line: passed on to malloc when the block has to move
+ * @return: 0 on success else -1 with the reason in get_errno. On failure *ptr
+ * is unchanged and the block is still valid.
+ *
+ * @implementation_details:
+ * The block grows in place whenever it can, no copy and no second block:
+ * 1. shrinking always stays in place, a tail big enough for a block of its
+ *    own is freed (and merged with a free block after it).
+ * 2. the top block grows into the unused space below __HEAP_LIMIT.
+ * 3. a block followed by a free block that is big enough takes it over, the
+ *    part it does not need is split off again.
+ * Only when neither works the content is copied (2 bytes at a time) into a new
+ * block and the old one is freed.
+ */
+int realloc(uint8_ptr_ptr_t ptr, uint16_t size, uint16_t line);
+
+/**
+ * @function:
+ * calloc: Allocates a block for count elements of size bytes, all bytes 0.
+ *
+ * @param ptr: receives the 2 byte aligned block
+ * @return: 0 on success else -1, also when count * size does not fit in 16
+ * bits. The block is cleared 2 bytes at a time.
+ */
+int calloc(uint16_t count, uint16_t size, uint8_ptr_ptr_t ptr, uint16_t line);
+
+/**
+ * @function:
+ * heap_fragmentation
+ *
+ * @purpose:
+ * measure how scattered the free memory is.
+ *
+ * @return:
+ * the percentage (0 - 100) of the free memory that is not part of the largest
+ * free area. The space between the top of the heap and __HEAP_LIMIT counts as
+ * one free area. 0 means every free byte can be handed out in a single
+ * allocation, a value close to 100 means the free memory is spread over many
+ * small blocks and large requests will fail even though enough bytes are free.
+ */
+uint8_t heap_fragmentation();
+
+/**
+ * @heap_stats:
+ * a snapshot of the heap, filled by heap_stats. Byte counts are capacities
+ * (payload bytes), the headers and guard bytes are not included.
+ */
+typedef struct {
+  // bytes in allocated blocks
+  uint16_t used_bytes;
+  // number of allocated blocks
+  uint16_t used_blocks;
+  // bytes in free blocks plus what a new block can hold in the unused space
+  // between the top of the heap and __HEAP_LIMIT (less its header and guard
+  // byte)
+  uint16_t free_bytes;
+  // number of blocks on the free lists
+  uint16_t free_blocks;
+  // the largest free block, or the largest block the top of the heap can
+  // still hold if that is larger. A request for more fails.
+  uint16_t largest_free;
+  // percentage of free_bytes that is not part of largest_free, see
+  // heap_fragmentation
+  uint8_t fragmentation;
+  // address of the top of the heap (__HEAP_END)
+  uint16_t heap_end;
+  // the highest __HEAP_END since reset, the high-water mark of the heap
+  uint16_t peak_end;
+} heap_stats_t;
+
+/**
+ * @function:
+ * heap_stats
+ *
+ * @purpose:
+ * fill stats with the current state of the heap. The counters are kept up to
+ * date by malloc and free, only the free list of the largest size class is
+ * walked, so this is cheap enough to poll from telemetry.
+ */
+void heap_stats(heap_stats_t *stats);
+
+/**
+ * @function:
+ * heap_dump
+ *
+ * @purpose:
+ * transmit the block map of the heap over usart0: one line per block with the
+ * address of the payload, used or free and the capacity, then the top of the
+ * heap and the bytes left below __HEAP_LIMIT. An allocated block whose guard
+ * byte was overwritten is marked. usart0 must be initialized (usart0_init).
+ *
+ * heap 0x0120 - 0x07ff
+ * 0x0122 used 15
+ * 0x0134 free 31
+ * 0x0154 top 1707
+ */
+void heap_dump();
+
+/**
+ * @leak_tracking:
+ * utils built with `make clean all MALLOC_TRACK=1` records the line argument of
+ * malloc, calloc and realloc for every live block in a side table (32 entries
+ * by default, -DMALLOC_TRACK_SLOTS=n to change it). heap_leak_report lists the
+ * blocks that are still allocated, grouped by call site. Without MALLOC_TRACK
+ * the tracking code is not compiled at all and calling heap_leak_report is a
+ * link error.
+ *
+ * Pass MALLOC_SITE as the line argument to record the file as well. Define
+ * MALLOC_FILE_ID (0 - 15) before including malloc.h, one number per source
+ * file:
+ *
+ * #define MALLOC_FILE_ID 2
+ * #include "malloc.h"
+ *
+ * malloc(16, &frame, MALLOC_SITE);
+ */
+#ifndef MALLOC_FILE_ID
+#define MALLOC_FILE_ID 0
+#endif
+#define MALLOC_SITE_LINE_BITS 12
+#define MALLOC_SITE_LINE_MASK 0x0fff
+#define MALLOC_SITE                                                            \
+  ((uint16_t)(((MALLOC_FILE_ID) << MALLOC_SITE_LINE_BITS) |                    \
+              (__LINE__ & MALLOC_SITE_LINE_MASK)))
+
+/**
+ * @function:
+ * heap_leak_report
+ *
+ * @purpose:
+ * transmit the live blocks over usart0, one line per call site with the
+ * number of blocks and their bytes, then the number of blocks that did not
+ * fit in the table. Only with MALLOC_TRACK. usart0 must be initialized.
+ *
+ * leak report
+ * file 2 line 88: 3 blocks 45 bytes
+ * file 0 line 130: 1 blocks 7 bytes
+ */
+void heap_leak_report();
+
+/**
+ * @interrupt_safety:
+ * utils built with `make clean all MALLOC_ISR_SAFE=1` can allocate and free
+ * from interrupt handlers (e.g. a packet buffer in the usart receive
+ * interrupt). malloc, free, realloc, calloc and heap_stats save SREG, disable
+ * interrupts while they work on the heap and write SREG back, so interrupts
+ * stay off for a caller that had them off. How long they are off:
+ *
+ * - malloc and free: the whole call, a fixed number of steps (see
+ *   @worst_case), hundreds of cycles. `make run` in
+ *   examples/sram/malloc-benchmark measures the worst case of both variants
+ * - realloc and calloc: no longer than one malloc or free at a time. The copy
+ *   of realloc and the zeroing of calloc run with interrupts enabled.
+ * - heap_stats: the walk of the free list of the largest size class, about 30
+ *   cycles per block on it. At worst every free block is on that list, every
+ *   other block of the heap: about 110 blocks, 3600 cycles (0.23 ms at 16 MHz)
+ *   on the atmega328p. The fragmentation percentage is computed after
+ *   interrupts are enabled again.
+ *
+ * heap_dump and heap_leak_report are not protected, call them when no
+ * interrupt allocates.
+ *
+ * An ISR can still find the heap used up by main. For that case there is a
+ * reserve of 4 slots of 32 bytes (-DMALLOC_ISR_RESERVE_SLOTS=n and
+ * -DMALLOC_ISR_RESERVE_SIZE=n to change it) that only malloc_from_isr draws
+ * from. Link pool.o as well. Without MALLOC_ISR_SAFE none of this is compiled
+ * and calling malloc_from_isr is a link error.
+ */
+
+/**
+ * @function:
+ * malloc_from_isr
+ *
+ * @purpose:
+ * malloc for interrupt handlers. Tries the heap first, when the heap has no
+ * room and the request fits in a reserve slot the block comes from the ISR
+ * reserve. The reserve is only used when the I bit of SREG is clear, called
+ * with interrupts enabled this is plain malloc. A reserve block is freed with
+ * free like any other block, realloc rejects it.
+ *
+ * @note: a clear I bit is all this checks, it can not tell an ISR from main
+ * inside its own critical section (cli, or a saved SREG with the I bit
+ * cleared). Main calling malloc_from_isr there drains the reserve the ISRs
+ * count on. Only call it from interrupt handlers, main uses malloc.
+ *
+ * @return: 0 on success else -1 (heap and reserve both exhausted)
+ */
+int malloc_from_isr(uint16_t size, uint8_ptr_ptr_t ptr, uint16_t line);
+
+/**
+ * @function:
+ * heap_isr_reserve_available
+ *
+ * @return: the number of free slots in the ISR reserve. Only with
+ * MALLOC_ISR_SAFE.
+ */
+uint8_t heap_isr_reserve_available();
+
+/**
+ * @stack_heap_collision:
+ * crt.s writes a canary word at __HEAP_LIMIT at boot, the lowest 2 bytes of
+ * the stack reserve (see the SRAM budget in default.ld). The heap never
+ * allocates past __HEAP_LIMIT, so the canary only changes when the stack grew
+ * out of its reserve into heap territory (or something wrote past the end of
+ * the top block). malloc and free compare it on every call (a load and a
+ * compare) and call panic with the handler set by heap_set_panic_handler and
+ * the message "Stack/Heap collision". It differs from the stack paint
+ * (0xC5 0xC5) so a painted stack never looks like an intact canary.
+ */
+#define HEAP_CANARY 0x5AA5
+
+/**
+ * @function:
+ * heap_check
+ *
+ * @purpose:
+ * check the canary outside of malloc and free, e.g. from a timer interrupt, so
+ * a stack overflow is caught even when the program does not allocate. Works
+ * from the start of main, before the first malloc.
+ */
+void heap_check();
+
+/**
+ * @function:
+ * heap_set_panic_handler
+ *
+ * @purpose:
+ * set the function panic calls when the canary is overwritten. It gets the
+ * message as its argument. The default (or passing 0) disables interrupts and
+ * stops. A handler should not use the heap and should not return, the stack
+ * has already destroyed whatever was below it.
+ */
+void heap_set_panic_handler(void (*handler)(void_ptr_t));
+
 /**
  * @function:
  * get_errno
@@ -0,0 +1,52 @@
+#ifndef AVR_OVERLAY_H
+#define AVR_OVERLAY_H
+
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * This module will provide a way to let buffers that are never used at the
+ * same time share the same SRAM.
+ *
+ * @knowledge:
+ * Every global buffer normally gets its own bytes in .bss for the whole life
+ * of the program. If the program runs in phases (provision the EEPROM, then
+ * talk over the usart, then sample the ADC) the buffer of one phase is dead
+ * while the others run. default.ld places the buffers of every phase at the
+ * same address (an OVERLAY), so all phases together only cost the SRAM of the
+ * largest one. Unlike malloc this costs nothing at runtime, the addresses are
+ * fixed at link time. `make overlay` (part of `make all`) prints what was saved.
+ *
+ * The price is that the phases must never overlap. When the program moves to
+ * another phase the buffers of the previous one are overwritten. crt.s does
+ * not clear overlay buffers, a phase must initialize its buffers itself.
+ */
+
+/**
+ * number of phases default.ld defines (.overlay0 ... .overlay3). A buffer in
+ * any other phase fails the link.
+ */
+#define OVERLAY_PHASES 4
+
+/**
+ * macro to place a buffer in an overlay phase (0 ... OVERLAY_PHASES - 1).
+ * Give the phases names in your program, the name is expanded before it is
+ * turned into the section name. Overlay buffers can not have an initializer.
+ *
+ * #define PHASE_PROVISION 0
+ * #define PHASE_USART 1
+ *
+ * uint8_t provision_buffer[64] OVERLAY(PHASE_PROVISION);
+ * uint8_t frame[128] OVERLAY(PHASE_USART);
+ * uint8_t frame_length OVERLAY(PHASE_USART);
+ *
+ * @note:
+ * the section name starts with .bss so the compiler does not store anything
+ * for the buffer in the executable (nobits), just like .bss.
+ */
+#define OVERLAY(phase) OVERLAY_SECTION(phase)
+#define OVERLAY_SECTION(phase) __attribute__((section(".bss.overlay" #phase)))
+
+#endif // AVR_OVERLAY_H
@@ -0,0 +1,140 @@
+#ifndef AVR_POOL_H
+#define AVR_POOL_H
+
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * This module will provide a fixed size object pool. A pool carves a region of
+ * SRAM into count slots of slot_size bytes. pool_alloc hands out one slot,
+ * pool_free gives it back. Use it for the objects a program allocates over and
+ * over with the same size (packet descriptors, timer nodes, messages) instead
+ * of malloc.
+ *
+ * @knowledge:
+ * malloc pays a 2 byte header, a guard byte and rounding on every block and
+ * has to find a block that fits. A pool knows the size of every object up
+ * front, so it needs neither:
+ *
+ * 1. no header: a slot is exactly slot_size bytes, the region of a pool of 10
+ *    slots of 6 bytes is 60 bytes.
+ * 2. O(1): the free slots form a list. The first byte of a free slot holds the
+ *    index of the next free slot (an intrusive list, it lives in memory that is
+ *    unused anyway). pool_alloc pops the head, pool_free pushes the slot back.
+ * 3. double free detection: a bitmap outside the slots has one bit per slot,
+ *    set while the slot is handed out. This costs 1 byte per 8 slots for the
+ *    whole pool, not per object.
+ *
+ * The region and the bitmap belong to the caller, so they can be a static
+ * array, an OVERLAY buffer (overlay.h) or a block from malloc.
+ *
+ * #define PACKETS 8
+ * uint8_t packet_region[POOL_REGION_SIZE(sizeof(packet_t), PACKETS)];
+ * uint8_t packet_map[POOL_MAP_SIZE(PACKETS)];
+ * pool_t packets;
+ *
+ * pool_init(&packets, packet_region, packet_map, sizeof(packet_t), PACKETS);
+ * pool_alloc(&packets, (uint8_ptr_ptr_t)&packet);
+ * pool_free(&packets, (uint8_ptr_t)packet);
+ */
+
+#include "types.h"
+
+/**
+ * the largest number of slots in one pool. Slot indices are 1 byte and
+ * POOL_END (0xff) marks the end of the free list.
+ */
+#define POOL_MAX_SLOTS 255
+#define POOL_END 0xff
+
+/**
+ * macros to size the memory a pool needs
+ */
+#define POOL_REGION_SIZE(slot_size, count) ((slot_size) * (count))
+#define POOL_MAP_SIZE(count) (((count) + 7) >> 3)
+
+/**
+ * the state of one pool. Treat the fields as private, they are only in the
+ * header so a pool can be a static variable.
+ */
+typedef struct {
+  // first byte of slot 0
+  uint8_ptr_t region;
+  // one bit per slot, 1 while the slot is allocated
+  uint8_ptr_t map;
+  // bytes per slot
+  uint16_t slot_size;
+  // number of slots
+  uint8_t count;
+  // index of the first free slot, POOL_END when the pool is empty
+  uint8_t free_head;
+  // number of slots handed out
+  uint8_t used;
+} pool_t;
+
+/**
+ * @function:
+ * pool_init
+ *
+ * @purpose:
+ * set up a pool over region. Every slot is free afterwards, call it again to
+ * drop every slot at once.
+ *
+ * @param pool: the pool to set up
+ * @param region: POOL_REGION_SIZE(slot_size, count) bytes for the slots
+ * @param map: POOL_MAP_SIZE(count) bytes for the bitmap
+ * @param slot_size: bytes per slot (at least 1)
+ * @param count: number of slots (1 ... POOL_MAX_SLOTS)
+ * @return: 0 on success else -1 (slot_size or count out of range)
+ */
+int pool_init(pool_t *pool, uint8_ptr_t region, uint8_ptr_t map,
+              uint16_t slot_size, uint8_t count);
+
+/**
+ * @function:
+ * pool_alloc
+ *
+ * @purpose:
+ * take a free slot from the pool. The content of the slot is undefined.
+ *
+ * @param pool: the pool to allocate from
+ * @param ptr: receives the address of the slot
+ * @return: 0 on success else -1 with "Pool exhausted" in pool_get_errno
+ */
+int pool_alloc(pool_t *pool, uint8_ptr_ptr_t ptr);
+
+/**
+ * @function:
+ * pool_free
+ *
+ * @purpose:
+ * give a slot back to the pool.
+ *
+ * @param pool: the pool the slot was allocated from
+ * @param ptr: address returned by pool_alloc
+ * @return: 0 on success else -1 with the reason in pool_get_errno: ptr is not
+ * the start of a slot of this pool, or the slot is already free (double free).
+ */
+int pool_free(pool_t *pool, uint8_ptr_t ptr);
+
+/**
+ * @function:
+ * pool_available
+ *
+ * @return: the number of free slots left in the pool
+ */
+uint8_t pool_available(pool_t *pool);
+
+/**
+ * @function:
+ * pool_get_errno
+ *
+ * @purpose:
+ * This function will return a string representation of the error that caused
+ * the last pool function to return -1.
+ */
+uint8_ptr_t pool_get_errno();
+
+#endif // AVR_POOL_H
@@ -0,0 +1,94 @@
+#ifndef AVR_PROGMEM_H
+#define AVR_PROGMEM_H
+
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * This module will provide a way to keep constant data (strings, tables) in
+ * flash only and read it from there.
+ *
+ * @knowledge:
+ * The AVR is a Harvard architecture. Flash (program memory) and SRAM (data
+ * memory) are separate address spaces. A normal pointer dereference compiles
+ * to ld/ldd which reads SRAM. Anything the compiler reads that way (.data and
+ * .rodata, which includes every string literal) must be copied from flash to
+ * SRAM by crt.s before main, so it costs flash AND SRAM. Data marked PROGMEM
+ * stays in flash and costs no SRAM, but it must be read with the lpm (load
+ * program memory) instruction, which is what the functions and macros in this
+ * module do. A flash pointer passed to a normal function (or a normal pointer
+ * passed to a _P function) reads the wrong memory.
+ */
+
+#include "types.h"
+
+/**
+ * macro to place a constant in flash. The variable must be const. The linker
+ * script places the .progmem sections right after the vector table.
+ *
+ * const uint8_t table[] PROGMEM = {1, 2, 3};
+ */
+#define PROGMEM __attribute__((section(".progmem.data")))
+
+/**
+ * a pointer into flash (program memory). It is only a reminder for the reader,
+ * the compiler can not tell it apart from a pointer into SRAM.
+ */
+typedef const uint8_t *uint8_flash_ptr_t;
+
+/**
+ * macro to define a string literal that lives in flash only and evaluate to
+ * its (flash) address.
+ *
+ * usart0_transmit_bytes_P(PSTR("Hello World"));
+ */
+#define PSTR(str)                                                              \
+  (__extension__({                                                             \
+    static const uint8_t __pstr[] PROGMEM = (str);                             \
+    &__pstr[0];                                                                \
+  }))
+
+/**
+ * macro to read the byte at flash address addr. Loads Z with the address and
+ * uses lpm.
+ */
+#define pgm_read_byte(addr)                                                    \
+  (__extension__({                                                             \
+    uint8_t __result;                                                          \
+    asm volatile("lpm %0, Z" : "=r"(__result) : "z"(addr));                   \
+    __result;                                                                  \
+  }))
+
+/**
+ * macro to read the byte at flash pointer ptr and advance ptr by one. Uses the
+ * post increment form (lpm Rd, Z+) so walking a string costs no extra add.
+ * ptr must be a uint8_flash_ptr_t variable.
+ */
+#define pgm_read_byte_inc(ptr)                                                 \
+  (__extension__({                                                             \
+    uint8_t __result;                                                          \
+    asm volatile("lpm %0, Z+" : "=r"(__result), "+z"(ptr));                    \
+    __result;                                                                  \
+  }))
+
+/**
+ * @function:
+ * strlen_P
+ * @arguments: str - flash pointer to a null terminated string
+ * @return: uint16_t - the length of the string (without the terminator)
+ */
+uint16_t strlen_P(uint8_flash_ptr_t str);
+
+/**
+ * @function:
+ * memcpy_P
+ * @arguments: dest - SRAM destination, src - flash source, n - bytes to copy
+ * @return: void
+ * @description:
+ * copy n bytes from flash to SRAM.
+ */
+void memcpy_P(uint8_ptr_t dest, uint8_flash_ptr_t src, uint16_t n);
+
+#endif // AVR_PROGMEM_H
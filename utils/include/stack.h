@@ -0,0 +1,67 @@
+#ifndef AVR_STACK_H
+#define AVR_STACK_H
+
+/**
+ * @contact_info:
+ * Author: dev_jeb
+ * Email: developer_jeb@outlook.com
+ *
+ * @purpose:
+ * This module measures how much SRAM the stack really uses. It relies on crt.s
+ * painting the free SRAM between __HEAP_START and the stack with STACK_PAINT
+ * before main is called. Build crt.o with `make PAINT_STACK=1` in /common/,
+ * without painting the numbers below are meaningless.
+ *
+ *                    SRAM
+ *        |--------------------------|
+ *        |      .data + .bss        |
+ *        |        .noinit           |
+ *        |--------------------------|__HEAP_START
+ *        |   heap (grows up)        |
+ *        |--------------------------|__HEAP_LIMIT
+ *        |  heap canary (2 bytes)   |
+ *        |  0xC5 0xC5 0xC5 0xC5 ... |  never touched (free)
+ *        |--------------------------|high water mark
+ *        |   stack (grows down)     |
+ * RAMEND |--------------------------|
+ */
+
+#include "types.h"
+
+/**
+ * the byte crt.s paints the free SRAM with
+ */
+#define STACK_PAINT 0xC5
+
+/**
+ * @function:
+ * stack_high_water
+ *
+ * @purpose:
+ * return the largest number of bytes the stack has used since reset.
+ *
+ * @implementation:
+ * Scans up from __HEAP_LIMIT (the bottom of the stack reserve) to the first
+ * byte that lost its paint, the same as StackPaint of avr-libc. Every byte
+ * below it has kept the paint since reset, so the result never reports less
+ * than the stack used. Scanning down from the stack instead would stop at a
+ * local or buffer the program never wrote and report too little. The lowest
+ * address found (the mark) is remembered between calls, the cost is
+ * proportional to the painted bytes that are left.
+ */
+uint16_t stack_high_water();
+
+/**
+ * @function:
+ * stack_free_bytes
+ *
+ * @purpose:
+ * return the number of bytes between the heap canary above __HEAP_LIMIT and
+ * the high water mark, i.e. the part of the stack reserve the stack has never
+ * reached. The heap can not use these bytes (malloc stops at __HEAP_LIMIT).
+ *
+ * @note: calls stack_high_water() to update the mark first.
+ */
+uint16_t stack_free_bytes();
+
+#endif // AVR_STACK_H
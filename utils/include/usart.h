@@ -20,6 +20,7 @@
  */
 
 #include "avr-arch.h"
+#include "progmem.h"
 #include "types.h"
 
 /**
@@ -51,7 +52,8 @@
  * @purpose:
  * This function will ensure the USART module is powered.
  * It will set the UBRRnH:L register so the clock pulses at the desired rate
- * (baud rate) rate. It will enable the transmitter. It will set
+ * (baud rate) rate. It will enable the transmitter and the receiver (with its
+ * interrupt, see @rx_ring). It will set
  * the frame format to 8 data bits, no parity, 2 stop bit.
  *
  *  The TXCn flag can be used to check that the transmitter has completed
@@ -62,11 +64,195 @@
  **/
 void usart0_init(uint16_t ubrr_register_value);
 
+/**
+ * @tx_ring:
+ * Transmitting a byte at 9600 baud takes about 1ms. Instead of waiting for
+ * the transmitter, every transmit function below puts its bytes into a ring
+ * buffer and returns. The USART Data Register Empty interrupt (UDRIE0) moves
+ * the next byte into UDR0 whenever the transmitter can take one and turns
+ * itself off when the ring is empty. Interrupts must be enabled (sei) for the
+ * ring to drain.
+ *
+ * With interrupts disabled (inside an ISR, or before sei) nothing drains the
+ * ring, what happens then depends on the policy (see usart0_set_tx_policy):
+ *
+ * - USART_TX_BLOCK sends the bytes the old way: the queued bytes first so the
+ *   order is kept, then the new one, waiting for UDRE0 before each. A full
+ *   ring stalls the caller until it is empty, 64 bytes at 9600 baud are about
+ *   67 ms with interrupts off.
+ * - USART_TX_DROP and USART_TX_OVERWRITE never wait. The bytes are queued and
+ *   go out once interrupts are enabled again, a full ring drops the new byte
+ *   or the oldest one.
+ *
+ * usart0_flush always waits, with interrupts disabled it sends the ring the
+ * old way too. crt.s disables interrupts when main returns, so whatever is
+ * still in the ring then is never sent: call usart0_flush before returning
+ * from main or halting (e.g. at the end of a panic handler).
+ *
+ * The ring holds USART0_TX_BUFFER_SIZE bytes (a power of two, at most 128,
+ * -DUSART0_TX_BUFFER_SIZE=n when building utils). usart0_set_tx_policy picks
+ * what happens when it is full. The ring has one producer: do not transmit
+ * from an ISR while main transmits with interrupts enabled.
+ */
+#ifndef USART0_TX_BUFFER_SIZE
+#define USART0_TX_BUFFER_SIZE 64
+#endif
+#if (USART0_TX_BUFFER_SIZE & (USART0_TX_BUFFER_SIZE - 1)) != 0 ||             \
+    USART0_TX_BUFFER_SIZE > 128
+#error "USART0_TX_BUFFER_SIZE must be a power of two, at most 128"
+#endif
+
+/**
+ * what a transmit does when the ring is full
+ *
+ * USART_TX_BLOCK: wait until the interrupt has made room (the default)
+ * USART_TX_DROP: throw the new byte away
+ * USART_TX_OVERWRITE: throw the oldest queued byte away, the newest output
+ * wins (e.g. a status line that is sent over and over)
+ *
+ * Thrown away bytes are counted, see usart0_tx_dropped.
+ */
+typedef enum {
+  USART_TX_BLOCK = 0,
+  USART_TX_DROP,
+  USART_TX_OVERWRITE
+} usart_tx_policy_t;
+
+/**
+ * @function:
+ * usart0_set_tx_policy
+ * @purpose:
+ * choose what a transmit does when the ring is full
+ * @param: USART_TX_BLOCK, USART_TX_DROP or USART_TX_OVERWRITE
+ */
+void usart0_set_tx_policy(usart_tx_policy_t policy);
+
+/**
+ * @function:
+ * usart0_write
+ * @purpose:
+ * queue length bytes for transmission and return without waiting for the
+ * transmitter (unless the ring is full and the policy is USART_TX_BLOCK).
+ * @param: pointer to data, number of bytes
+ * @return: the number of bytes queued, less than length when USART_TX_DROP
+ * threw some away
+ */
+uint16_t usart0_write(uint8_ptr_t data, uint16_t length);
+
+/**
+ * @function:
+ * usart0_flush
+ * @purpose:
+ * wait until the ring is empty and the last byte has left the shift register
+ * (TXC0). Call it before sleeping, resetting or turning the transmitter off.
+ */
+void usart0_flush();
+
+/**
+ * @function:
+ * usart0_tx_dropped
+ * @return: bytes thrown away by USART_TX_DROP and USART_TX_OVERWRITE since
+ * usart0_init
+ */
+uint16_t usart0_tx_dropped();
+
+/**
+ * @multi_image:
+ * an image of a multi-image flash (image.ld in /common/) has no vector table,
+ * an enabled USART interrupt would jump to __bad_interrupt of the loader and
+ * reset the chip. image.ld defines __image_no_vectors and this module checks
+ * for it: in an image usart0_init leaves RXCIE0 off, every transmit sends its
+ * byte right away (whatever the policy) and usart0_available, usart0_read and
+ * usart0_read_until poll the receiver into the ring. Call them at least every
+ * two frames (about 2ms at 9600 baud) or bytes are lost as data overruns.
+ */
+
+/**
+ * @rx_ring:
+ * usart0_init enables the receiver and the USART Receive Complete interrupt
+ * (RXCIE0). The interrupt moves every received byte from UDR0 into a ring
+ * buffer right away, so the two byte hardware buffer of the receiver never
+ * overflows while main is busy. Main takes the bytes out with usart0_read and
+ * usart0_read_until, neither of them waits. Interrupts must be enabled (sei)
+ * to receive.
+ *
+ * The ring holds USART0_RX_BUFFER_SIZE bytes (a power of two, at most 128,
+ * -DUSART0_RX_BUFFER_SIZE=n when building utils). A byte that arrives while it
+ * is full is thrown away and counted, see usart0_rx_stats. A byte with a frame
+ * or parity error is thrown away and counted as well.
+ */
+#ifndef USART0_RX_BUFFER_SIZE
+#define USART0_RX_BUFFER_SIZE 32
+#endif
+#if (USART0_RX_BUFFER_SIZE & (USART0_RX_BUFFER_SIZE - 1)) != 0 ||             \
+    USART0_RX_BUFFER_SIZE > 128
+#error "USART0_RX_BUFFER_SIZE must be a power of two, at most 128"
+#endif
+
+/**
+ * receive errors since usart0_init. A growing ring_overflows means the ring
+ * is too small for the traffic or main reads too rarely, a growing
+ * data_overruns that the receive interrupt was held off (interrupts disabled)
+ * for longer than two frames.
+ */
+typedef struct {
+  // FE0: the stop bit of a byte was 0 (baud rate mismatch, line noise)
+  uint16_t frame_errors;
+  // DOR0: the hardware buffer was full, bytes before this one were lost
+  uint16_t data_overruns;
+  // UPE0: parity mismatch (only with parity enabled in UCSR0C)
+  uint16_t parity_errors;
+  // the ring was full, the byte was thrown away
+  uint16_t ring_overflows;
+} usart_rx_stats_t;
+
+/**
+ * @function:
+ * usart0_available
+ * @return: the number of received bytes in the ring
+ */
+uint8_t usart0_available();
+
+/**
+ * @function:
+ * usart0_read
+ * @purpose:
+ * take up to length received bytes out of the ring, without waiting for more
+ * @param: pointer to the destination, its size
+ * @return: the number of bytes copied (0 when nothing was received)
+ */
+uint8_t usart0_read(uint8_ptr_t buffer, uint8_t length);
+
+/**
+ * @function:
+ * usart0_read_until
+ * @purpose:
+ * take one terminated record (e.g. a line, terminator '\n') out of the ring,
+ * without waiting. When the ring holds the terminator the bytes up to and
+ * including it are copied. When it does not but already holds length bytes
+ * (a record longer than the buffer) length bytes are copied. Otherwise
+ * nothing is taken, call again later.
+ * @param: pointer to the destination, its size, the terminator
+ * @return: the number of bytes copied, 0 if no complete record is there yet
+ */
+uint8_t usart0_read_until(uint8_ptr_t buffer, uint8_t length,
+                          uint8_t terminator);
+
+/**
+ * @function:
+ * usart0_rx_stats
+ * @purpose:
+ * copy the receive error counters (taken with interrupts disabled so no
+ * counter is half updated)
+ */
+void usart0_rx_stats(usart_rx_stats_t *stats);
+
 /**
  * @function:
  * usart0_transmit_byte
  * @purpose:
- * Asynchronously transmit a byte over the USART0 module.
+ * Asynchronously transmit a byte over the USART0 module (queued, see
+ * @tx_ring).
  * @param: byte to transmit
  */
 void usart0_transmit_byte(uint8_t data);
@@ -82,4 +268,38 @@ void usart0_transmit_byte(uint8_t data);
  */
 void usart0_transmit_bytes(uint8_ptr_t ptr);
 
+/**
+ * @function:
+ * usart0_transmit_bytes_P
+ * @purpose:
+ * Same as usart0_transmit_bytes but the null terminated sequence lives in
+ * flash (see progmem.h). Use it with PSTR("...") so log and banner text never
+ * takes SRAM.
+ * @param: flash pointer to data
+ * @note: undefined behaviour when terminator not present
+ */
+void usart0_transmit_bytes_P(uint8_flash_ptr_t ptr);
+
+/**
+ * @function:
+ * usart0_transmit_uint16
+ * @purpose:
+ * Transmit the decimal representation of value (no leading zeros) over the
+ * USART0 module.
+ * @param: value to transmit
+ * @note: this does not divide. We link without libgcc (-nostdlib) so there is
+ * no division routine to call.
+ */
+void usart0_transmit_uint16(uint16_t value);
+
+/**
+ * @function:
+ * usart0_transmit_hex16
+ * @purpose:
+ * Transmit value as 0x followed by 4 hexadecimal digits over the USART0
+ * module. Meant for addresses, e.g. (uint16_t)ptr.
+ * @param: value to transmit
+ */
+void usart0_transmit_hex16(uint16_t value);
+
 #endif // AVR_USART_H
\ No newline at end of file
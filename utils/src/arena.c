@@ -0,0 +1,99 @@
+#include "arena.h"
+#include "malloc.h"
+#include "types.h"
+
+/**
+ * @implementation_details:
+ * the error of the last arena function that returned -1, the same scheme as
+ * malloc.c.
+ *
+ * Error Definitions:
+ * 0: No error (Initial value)
+ * 1: The request does not fit in the rest of the arena
+ * 2: Released a mark above the top of the arena
+ * 3: malloc could not provide the block for arena_init_heap
+ */
+enum ERRNO_VALUE {
+  NO_ERROR = 0,
+  ARENA_FULL,
+  INVALID_MARK,
+  MEMORY_ALLOCATION_FAILED
+};
+static enum ERRNO_VALUE ERNO = NO_ERROR;
+
+void arena_init(arena_t *arena, uint8_ptr_t region, uint16_t size) {
+  arena->start = region;
+  arena->end = region + size;
+  // keep every allocation 2 byte aligned, like malloc
+  if (((uint16_t)region & 1) != 0 && size > 0) {
+    arena->start++;
+  }
+  arena->top = arena->start;
+  arena->heap_block = 0;
+}
+
+int arena_init_heap(arena_t *arena, uint16_t size, uint16_t line) {
+  uint8_ptr_t block;
+  if (malloc(size, &block, line) != 0) {
+    ERNO = MEMORY_ALLOCATION_FAILED;
+    return -1;
+  }
+  arena_init(arena, block, size);
+  arena->heap_block = 1;
+  return 0;
+}
+
+int arena_alloc(arena_t *arena, uint16_t size, uint8_ptr_ptr_t ptr) {
+  // round up so the next allocation is aligned too
+  uint16_t rounded = (size + 1) & ~1;
+  if (rounded < size || rounded > (uint16_t)(arena->end - arena->top)) {
+    ERNO = ARENA_FULL;
+    return -1;
+  }
+  *ptr = arena->top;
+  arena->top += rounded;
+  return 0;
+}
+
+arena_mark_t arena_mark(arena_t *arena) {
+  return (arena_mark_t)(arena->top - arena->start);
+}
+
+int arena_release(arena_t *arena, arena_mark_t mark) {
+  if (mark > (uint16_t)(arena->top - arena->start)) {
+    ERNO = INVALID_MARK;
+    return -1;
+  }
+  arena->top = arena->start + mark;
+  return 0;
+}
+
+void arena_reset(arena_t *arena) { arena->top = arena->start; }
+
+uint16_t arena_remaining(arena_t *arena) {
+  return (uint16_t)(arena->end - arena->top);
+}
+
+int arena_destroy(arena_t *arena) {
+  arena_reset(arena);
+  if (!arena->heap_block) {
+    return 0;
+  }
+  arena->heap_block = 0;
+  // the malloc block starts at start, malloc blocks are always aligned
+  return free(arena->start);
+}
+
+uint8_ptr_t arena_get_errno() {
+  switch (ERNO) {
+  case NO_ERROR:
+    return (uint8_ptr_t) "No error";
+  case ARENA_FULL:
+    return (uint8_ptr_t) "Arena full";
+  case INVALID_MARK:
+    return (uint8_ptr_t) "Invalid mark";
+  case MEMORY_ALLOCATION_FAILED:
+    return (uint8_ptr_t) "Memory allocation failed";
+  }
+  return (uint8_ptr_t) "Unknown error";
+}
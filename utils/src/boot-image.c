@@ -0,0 +1,21 @@
+#include "avr-arch.h"
+#include "boot.h"
+#include "types.h"
+
+/**
+ * @implementation_details:
+ * kept apart from boot-profile.c: __image_select only exists in a multi-image
+ * flash (crt.s built with CRT_MULTI_IMAGE, or image.ld), __boot_profile only
+ * with CRT_BOOT_PROFILE. Each object file references the symbols of one crt
+ * option, so linking either one does not need the other option.
+ */
+void boot_image_switch(uint8_t slot) {
+  __image_select = slot;
+  // the timed sequence: WDCE and WDE, then the new setting within 4 cycles
+  cli();
+  WDTCSR = (1 << WDCE) | (1 << WDE);
+  // shortest timeout (16ms), reset instead of interrupt
+  WDTCSR = (1 << WDE);
+  while (1) {
+  }
+}
@@ -0,0 +1,39 @@
+#include "boot.h"
+#include "progmem.h"
+#include "types.h"
+#include "usart.h"
+
+/**
+ * @function:
+ * print_stage
+ * @purpose:
+ * transmit one line of the boot profile: the stage name, the cycles since
+ * __init and the cycles spent in the stage itself.
+ * @return: the cumulative count to use as the start of the next stage
+ */
+static uint16_t print_stage(uint8_flash_ptr_t name, uint16_t cycles,
+                            uint16_t previous) {
+  usart0_transmit_bytes_P(name);
+  usart0_transmit_uint16(cycles);
+  usart0_transmit_bytes_P(PSTR(" (+"));
+  // a stage that did not run reads 0, it took no time
+  usart0_transmit_uint16(cycles ? cycles - previous : 0);
+  usart0_transmit_byte(')');
+  usart0_transmit_byte(NEW_LINE);
+  usart0_transmit_byte(CARRIAGE_RETURN);
+  return cycles ? cycles : previous;
+}
+
+void boot_profile_print() {
+  uint16_t previous = 0;
+  usart0_transmit_bytes_P(PSTR("boot profile (cycles since reset)"));
+  usart0_transmit_byte(NEW_LINE);
+  usart0_transmit_byte(CARRIAGE_RETURN);
+  previous =
+      print_stage(PSTR("load_data:   "), __boot_profile.load_data, previous);
+  previous =
+      print_stage(PSTR("zero_bss:    "), __boot_profile.zero_bss, previous);
+  previous = print_stage(PSTR("paint_stack: "),
+                         __boot_profile.paint_stack, previous);
+  print_stage(PSTR("call_main:   "), __boot_profile.call_main, previous);
+}
@@ -7,4 +7,19 @@ void str_copy(uint8_ptr_t dest, uint8_ptr_t src) {
     src++;
   }
   *dest = '\0';
-};
\ No newline at end of file
+};
+
+uint16_t divide(uint16_t dividend, uint16_t divisor) {
+  uint16_t quotient = 0;
+  uint16_t remainder = 0;
+  for (uint8_t bit = 16; bit > 0; bit--) {
+    remainder = (remainder << 1) | (dividend >> 15);
+    dividend <<= 1;
+    quotient <<= 1;
+    if (remainder >= divisor) {
+      remainder -= divisor;
+      quotient |= 1;
+    }
+  }
+  return quotient;
+}
@@ -0,0 +1,362 @@
+#include "handle.h"
+#include "progmem.h"
+#include "types.h"
+#include "usart.h"
+
+/**
+ * @implementation_details:
+ * the error of the last handle function that returned -1, the same scheme as
+ * malloc.c.
+ *
+ * Error Definitions:
+ * 0: No error (Initial value)
+ * 1: handle_heap_init got a region or handle count it can not handle
+ * 2: Not enough room for the request, even after a compaction
+ * 3: Every handle is in use
+ * 4: The handle is not allocated
+ * 5: Freed a block that is still locked
+ * 6: Unlocked a block that is not locked, or locked it 255 times
+ */
+enum ERRNO_VALUE {
+  NO_ERROR = 0,
+  INVALID_HEAP,
+  OUT_OF_MEMORY,
+  OUT_OF_HANDLES,
+  INVALID_HANDLE,
+  BLOCK_LOCKED,
+  INVALID_LOCK
+};
+static enum ERRNO_VALUE ERNO = NO_ERROR;
+
+/**
+ * @implementation_details:
+ * the blocks tile the region from data up to top, free space above top is one
+ * free area. Every block starts with a 4 byte header:
+ *
+ *       +-------block-------+
+ *       |  size (payload)   |
+ *       +-----block + 2-----+
+ *       |      handle       |
+ *       +-----block + 3-----+
+ *       |    lock count     |
+ *       +-----block + 4-----+
+ *       |      payload      |
+ *       +--block + 4 + size-+
+ *
+ * The size is even so every header and payload stays 2 byte aligned. A free
+ * block has the handle HANDLE_NONE. Compaction needs the handle in the header
+ * to find the table entry of a block it moved.
+ */
+typedef struct {
+  uint16_t size;
+  uint8_t handle;
+  uint8_t locks;
+} block_t;
+
+#define UNUSED_ENTRY 0xffff
+
+static block_t *header(uint8_ptr_t block) { return (block_t *)block; }
+
+static uint8_ptr_t next_block(uint8_ptr_t block) {
+  return block + HANDLE_BLOCK_OVERHEAD + header(block)->size;
+}
+
+/**
+ * @function:
+ * handle_block
+ * @arguments: handle_heap_t *heap, handle_t handle
+ * @return: the block of handle, 0 with ERNO set if the handle is not allocated
+ */
+static uint8_ptr_t handle_block(handle_heap_t *heap, handle_t handle) {
+  if (handle >= heap->handles || heap->table[handle] == UNUSED_ENTRY) {
+    ERNO = INVALID_HANDLE;
+    return 0x0000;
+  }
+  return heap->data + heap->table[handle];
+}
+
+/**
+ * @function:
+ * copy_down
+ * @arguments: destination, source, bytes (even)
+ * @description:
+ * move a block to a lower address 2 bytes at a time. The two may overlap, a
+ * forward copy reads every word before it is overwritten.
+ */
+static void copy_down(uint8_ptr_t destination, uint8_ptr_t source,
+                      uint16_t bytes) {
+  uint16_ptr_t to = (uint16_ptr_t)destination;
+  uint16_ptr_t from = (uint16_ptr_t)source;
+  for (uint16_t words = bytes >> 1; words > 0; words--) {
+    *to++ = *from++;
+  }
+}
+
+/**
+ * @function:
+ * find_space
+ * @arguments: handle_heap_t *heap, uint16_t size (even)
+ * @return: a block with a payload of size bytes, not yet owned by a handle.
+ * 0 if no hole and not the top of the heap can hold it.
+ * @description:
+ * first fit over the holes, then the top. Free blocks next to each other are
+ * merged on the way, a free run that ends at top is given back to the top.
+ * A hole is split when the rest can hold a header of its own.
+ */
+static uint8_ptr_t find_space(handle_heap_t *heap, uint16_t size) {
+  for (uint8_ptr_t block = heap->data; block < heap->top;
+       block = next_block(block)) {
+    if (header(block)->handle != HANDLE_NONE) {
+      continue;
+    }
+    uint8_ptr_t next = next_block(block);
+    while (next < heap->top && header(next)->handle == HANDLE_NONE) {
+      header(block)->size += HANDLE_BLOCK_OVERHEAD + header(next)->size;
+      next = next_block(next);
+    }
+    if (next == heap->top) {
+      heap->top = block;
+      break;
+    }
+    uint16_t found = header(block)->size;
+    if (found >= size) {
+      if (found - size >= HANDLE_BLOCK_OVERHEAD) {
+        uint8_ptr_t rest = block + HANDLE_BLOCK_OVERHEAD + size;
+        header(rest)->size = found - size - HANDLE_BLOCK_OVERHEAD;
+        header(rest)->handle = HANDLE_NONE;
+        header(rest)->locks = 0;
+        header(block)->size = size;
+      }
+      return block;
+    }
+  }
+  if ((uint16_t)(heap->end - heap->top) < HANDLE_BLOCK_OVERHEAD ||
+      (uint16_t)(heap->end - heap->top) - HANDLE_BLOCK_OVERHEAD < size) {
+    return 0x0000;
+  }
+  uint8_ptr_t block = heap->top;
+  header(block)->size = size;
+  heap->top += HANDLE_BLOCK_OVERHEAD + size;
+  return block;
+}
+
+int handle_heap_init(handle_heap_t *heap, uint8_ptr_t region, uint16_t size,
+                     uint8_t handles) {
+  uint8_ptr_t start = region;
+  // keep the table and every block 2 byte aligned
+  if (((uint16_t)region & 1) != 0 && size > 0) {
+    start++;
+    size--;
+  }
+  if (handles == 0 || handles > HANDLE_MAX_COUNT ||
+      (uint16_t)handles * 2 > size) {
+    ERNO = INVALID_HEAP;
+    return -1;
+  }
+  heap->table = (uint16_ptr_t)start;
+  heap->handles = handles;
+  heap->data = start + (uint16_t)handles * 2;
+  heap->top = heap->data;
+  heap->end = start + (size & ~1);
+  for (uint8_t handle = 0; handle < handles; handle++) {
+    heap->table[handle] = UNUSED_ENTRY;
+  }
+  heap->compactions = 0;
+  heap->last_compaction.bytes_moved = 0;
+  heap->last_compaction.blocks_moved = 0;
+  heap->last_compaction.reclaimed = 0;
+  heap->last_compaction.largest_before = 0;
+  heap->last_compaction.largest_after = 0;
+  return 0;
+}
+
+int handle_alloc(handle_heap_t *heap, uint16_t size, handle_t *handle) {
+  uint16_t rounded = (size + 1) & ~1;
+  if (size == 0 || rounded < size) {
+    ERNO = OUT_OF_MEMORY;
+    return -1;
+  }
+  handle_t free_handle = 0;
+  while (free_handle < heap->handles &&
+         heap->table[free_handle] != UNUSED_ENTRY) {
+    free_handle++;
+  }
+  if (free_handle == heap->handles) {
+    ERNO = OUT_OF_HANDLES;
+    return -1;
+  }
+  uint8_ptr_t block = find_space(heap, rounded);
+  if (block == 0x0000) {
+    // enough bytes may be free, just not in one piece
+    handle_compact(heap);
+    block = find_space(heap, rounded);
+  }
+  if (block == 0x0000) {
+    ERNO = OUT_OF_MEMORY;
+    return -1;
+  }
+  header(block)->handle = free_handle;
+  header(block)->locks = 0;
+  heap->table[free_handle] = (uint16_t)(block - heap->data);
+  *handle = free_handle;
+  return 0;
+}
+
+int handle_free(handle_heap_t *heap, handle_t handle) {
+  uint8_ptr_t block = handle_block(heap, handle);
+  if (block == 0x0000) {
+    return -1;
+  }
+  if (header(block)->locks != 0) {
+    ERNO = BLOCK_LOCKED;
+    return -1;
+  }
+  header(block)->handle = HANDLE_NONE;
+  heap->table[handle] = UNUSED_ENTRY;
+  if (next_block(block) == heap->top) {
+    heap->top = block;
+  }
+  return 0;
+}
+
+int handle_lock(handle_heap_t *heap, handle_t handle, uint8_ptr_ptr_t ptr) {
+  uint8_ptr_t block = handle_block(heap, handle);
+  if (block == 0x0000) {
+    return -1;
+  }
+  if (header(block)->locks == 0xff) {
+    ERNO = INVALID_LOCK;
+    return -1;
+  }
+  header(block)->locks++;
+  *ptr = block + HANDLE_BLOCK_OVERHEAD;
+  return 0;
+}
+
+int handle_unlock(handle_heap_t *heap, handle_t handle) {
+  uint8_ptr_t block = handle_block(heap, handle);
+  if (block == 0x0000) {
+    return -1;
+  }
+  if (header(block)->locks == 0) {
+    ERNO = INVALID_LOCK;
+    return -1;
+  }
+  header(block)->locks--;
+  return 0;
+}
+
+/**
+ * @implementation_details:
+ * one pass from the bottom up. destination is where the next block that can
+ * move goes. An unlocked block is copied down to destination and its table
+ * entry updated. A locked block stays, the gap between destination and it
+ * (free blocks and the space of blocks that moved away) becomes one free
+ * block and destination continues behind the locked block. Whatever is left
+ * between destination and the old top joins the free area at the top.
+ */
+void handle_compact(handle_heap_t *heap) {
+  handle_compaction_t *result = &heap->last_compaction;
+  result->bytes_moved = 0;
+  result->blocks_moved = 0;
+  result->largest_before = handle_largest_free(heap);
+
+  uint8_ptr_t destination = heap->data;
+  uint8_ptr_t block = heap->data;
+  while (block < heap->top) {
+    uint16_t length = HANDLE_BLOCK_OVERHEAD + header(block)->size;
+    uint8_ptr_t next = block + length;
+    if (header(block)->handle == HANDLE_NONE) {
+      block = next;
+      continue;
+    }
+    if (header(block)->locks != 0) {
+      if (destination != block) {
+        header(destination)->size =
+            (uint16_t)(block - destination) - HANDLE_BLOCK_OVERHEAD;
+        header(destination)->handle = HANDLE_NONE;
+        header(destination)->locks = 0;
+      }
+      destination = next;
+    } else {
+      if (destination != block) {
+        copy_down(destination, block, length);
+        heap->table[header(destination)->handle] =
+            (uint16_t)(destination - heap->data);
+        result->bytes_moved += length;
+        result->blocks_moved++;
+      }
+      destination += length;
+    }
+    block = next;
+  }
+  result->reclaimed = (uint16_t)(heap->top - destination);
+  heap->top = destination;
+  result->largest_after = handle_largest_free(heap);
+  heap->compactions++;
+}
+
+handle_compaction_t *handle_last_compaction(handle_heap_t *heap) {
+  return &heap->last_compaction;
+}
+
+uint16_t handle_largest_free(handle_heap_t *heap) {
+  uint16_t largest = 0;
+  // bytes of the run of free blocks we are in, headers included
+  uint16_t run = 0;
+  for (uint8_ptr_t block = heap->data; block < heap->top;
+       block = next_block(block)) {
+    if (header(block)->handle == HANDLE_NONE) {
+      run += HANDLE_BLOCK_OVERHEAD + header(block)->size;
+      continue;
+    }
+    if (run > HANDLE_BLOCK_OVERHEAD && run - HANDLE_BLOCK_OVERHEAD > largest) {
+      largest = run - HANDLE_BLOCK_OVERHEAD;
+    }
+    run = 0;
+  }
+  // a run that ends at top is part of the free area at the top
+  run += (uint16_t)(heap->end - heap->top);
+  if (run >= HANDLE_BLOCK_OVERHEAD && run - HANDLE_BLOCK_OVERHEAD > largest) {
+    largest = run - HANDLE_BLOCK_OVERHEAD;
+  }
+  return largest;
+}
+
+void handle_compaction_report(handle_heap_t *heap) {
+  handle_compaction_t *result = &heap->last_compaction;
+  usart0_transmit_bytes_P(PSTR("compaction "));
+  usart0_transmit_uint16(heap->compactions);
+  usart0_transmit_bytes_P(PSTR(": moved "));
+  usart0_transmit_uint16(result->blocks_moved);
+  usart0_transmit_bytes_P(PSTR(" blocks "));
+  usart0_transmit_uint16(result->bytes_moved);
+  usart0_transmit_bytes_P(PSTR(" bytes, reclaimed "));
+  usart0_transmit_uint16(result->reclaimed);
+  usart0_transmit_bytes_P(PSTR(" bytes, largest free "));
+  usart0_transmit_uint16(result->largest_before);
+  usart0_transmit_bytes_P(PSTR(" -> "));
+  usart0_transmit_uint16(result->largest_after);
+  usart0_transmit_byte(NEW_LINE);
+  usart0_transmit_byte(CARRIAGE_RETURN);
+}
+
+uint8_ptr_t handle_get_errno() {
+  switch (ERNO) {
+  case NO_ERROR:
+    return (uint8_ptr_t) "No error";
+  case INVALID_HEAP:
+    return (uint8_ptr_t) "Invalid heap";
+  case OUT_OF_MEMORY:
+    return (uint8_ptr_t) "Out of memory";
+  case OUT_OF_HANDLES:
+    return (uint8_ptr_t) "Out of handles";
+  case INVALID_HANDLE:
+    return (uint8_ptr_t) "Invalid handle";
+  case BLOCK_LOCKED:
+    return (uint8_ptr_t) "Block locked";
+  case INVALID_LOCK:
+    return (uint8_ptr_t) "Invalid lock";
+  }
+  return (uint8_ptr_t) "Unknown error";
+}
@@ -1,5 +1,8 @@
 #include "avr-arch.h"
+#include "common.h"
+#include "malloc.h"
 #include "panic.h"
+#include "pool.h"
 #include "types.h"
 #include "usart.h"
 
@@ -13,12 +16,17 @@
  * 0: No error (Initial value)
  * 1: Memory allocation failed
  * 2: Tried to free
+ * 3: Double free
+ * 4: The guard byte behind the payload was overwritten
+ * 5: pool_free rejected a slot of the ISR reserve (foreign slot or double free)
  */
-static enum ERRNO_VALUE {
+enum ERRNO_VALUE {
   NO_ERROR = 0,
   MEMORY_ALLOCATION_FAILED,
   ATTEMPTED_FREE_UNALLOCATED_BLOCK,
-  DOUBLE_FREE
+  DOUBLE_FREE,
+  OUT_OF_BOUNDS_WRITE,
+  INVALID_RESERVE_FREE
 };
 static enum ERRNO_VALUE ERNO = NO_ERROR;
 
@@ -27,15 +35,30 @@ static enum ERRNO_VALUE ERNO = NO_ERROR;
  * __HEAP_START is a symbol defined in the custom linker script used throughout
  * this project. It is the address of the first byte after the bss section in
  * sram. Remember, after the data and bss sections that our main program
- * expects.
+ * expects. The linker script keeps it 2 byte aligned.
+ *
+ * A linker symbol has an address but no storage. Declaring it as an array
+ * makes `__HEAP_START` evaluate to that address. (Declared as a pointer we
+ * would read whatever bytes happen to be stored at that address.)
  */
-extern uint8_ptr_t __HEAP_START;
+extern uint8_t __HEAP_START[];
 
 /**
  * @implementation_details:
- * __HEAP_END is a static symbol defined here. We will use this to point to the
- * next 2 byte aligned address after the memory block allocated the farthest
- * from the start of the heap.
+ * __HEAP_LIMIT is defined in the linker script as well. It is the first byte
+ * the heap may not use. Everything from __HEAP_LIMIT to the top of SRAM is
+ * reserved for the stack (__STACK_RESERVE). The linker fails the link when the
+ * static data, the heap and the reserve do not fit in SRAM, so a block that
+ * ends below __HEAP_LIMIT can never run into the reserved stack space.
+ */
+extern uint8_t __HEAP_LIMIT[];
+
+/**
+ * @implementation_details:
+ * __HEAP_END is a static symbol defined here. It points to the first byte
+ * after the block allocated the farthest from the start of the heap, which is
+ * where the header of the next new block goes. Blocks are 2 byte aligned and
+ * an even number of bytes long so __HEAP_END is always even.
  *
  * static so it is not visible outside this module.
  */
@@ -46,24 +69,169 @@ static uint8_ptr_t __HEAP_END = 0x0000;
  * we need a few bit masks to help us interact with the allocated block header.
  * We also need a few flags
  */
-static uint16_t MAGIC_NUMBER = 0x0003;
-static uint16_t ALLOCATED_MASK = 0x07;
-static uint16_t ACTIVE_MASK = 0x08;
-static uint16_t ACTIVE_SHIFT = 3;
-static uint16_t SIZE_MASK = 0xffe0;
-static uint16_t SIZE_SHIFT = 5;
+#define MAGIC_NUMBER 0x0003
+#define ALLOCATED_MASK 0x07
+#define ACTIVE_MASK 0x08
+#define ACTIVE_SHIFT 3
+#define SIZE_MASK 0xffe0
+#define SIZE_SHIFT 5
 
 /**
- * @function:
- * mergeBytes
- * @arguments: highByte, lowByte
- * @return: uint16_t
- * @description:
- * This function takes two bytes and merges them into a single 16 bit value.
+ * @implementation_details:
+ * MALLOC_RELEASE=1 (malloc-release.o, see the makefile in /utils/) builds the
+ * lean variant of the allocator for production:
+ *
+ * - no guard byte behind the payload, a block costs its 2 byte header only
+ * - no magic number in the header and no magic or guard check in free
+ *
+ * The size, active and PREV_FREE bits stay where they are, free lists,
+ * splitting and coalescing work the same. The capacity is even instead of odd
+ * so blocks stay 2 byte aligned without the guard byte. free still rejects
+ * pointers outside the heap and double frees (the active bit), both are a
+ * compare and protect the free lists.
+ *
+ * GUARD_BYTES is the number of bytes behind the payload, HEADER_MAGIC the
+ * magic bits written into every header.
  */
-uint16_t mergeBytes(uint8_t highByte, uint8_t lowByte) {
-  return (uint16_t)((highByte << 8) | lowByte);
-}
+#ifndef MALLOC_RELEASE
+#define MALLOC_RELEASE 0
+#endif
+
+#if MALLOC_RELEASE
+#define GUARD_BYTES 0
+#define HEADER_MAGIC 0x0000
+#else
+#define GUARD_BYTES 1
+#define HEADER_MAGIC MAGIC_NUMBER
+#endif
+
+/**
+ * @implementation_details:
+ * bytes a block takes on top of its capacity, the header and the guard byte
+ */
+#define BLOCK_OVERHEAD (2 + GUARD_BYTES)
+
+/**
+ * @implementation_details:
+ * bit 4 of the header (reserved until now) is set when the block right before
+ * this one in the heap is free. free() uses it to find out if it can merge with
+ * the previous block without walking the heap.
+ */
+#define PREV_FREE_MASK 0x10
+
+/**
+ * @implementation_details:
+ * the largest capacity the 11 bit size field can hold (odd in the debug
+ * variant, even in the release variant)
+ */
+#if MALLOC_RELEASE
+#define MAX_CAPACITY 0x07fe
+#else
+#define MAX_CAPACITY 0x07ff
+#endif
+
+/**
+ * @implementation_details:
+ * MALLOC_TLSF=1 (malloc-tlsf.o, see the makefile in /utils/) replaces the
+ * power of two free lists with a two-level segregated fit (TLSF) index, for
+ * callers that need a bound on the time malloc takes. See find_free_block.
+ */
+#ifndef MALLOC_TLSF
+#define MALLOC_TLSF 0
+#endif
+
+/**
+ * @implementation_details:
+ * segregated free lists. A freed block is pushed on the list (bucket) of its
+ * size class, class n holds the blocks with a capacity in [2^n, 2^(n + 1)).
+ * The 11 bit size field gives 11 classes. The lists are doubly linked so a
+ * block can be taken off its list in constant time when a neighbour is freed
+ * and the two are merged.
+ *
+ * Links are offsets of the payload from __HEAP_START instead of pointers. The
+ * first payload sits at offset 2, so offset 0 means "end of list".
+ *
+ * A free block is laid out as follows (boundary tags). The footer holds the
+ * capacity again at the very end of the block so the block after it can find
+ * the start of the free block (see PREV_FREE_MASK).
+ *
+ *       +------ptr - 2------+
+ *       |   header (free)   |
+ *       +--------ptr--------+
+ *       |   next in list    |
+ *       +------ptr + 2------+
+ *       |   prev in list    |
+ *       +------ptr + 4------+
+ *       |        ...        |
+ *       +ptr + size - 1 (*)-+
+ *       |  footer (size)    |
+ *       +--ptr + size + 1---+
+ *
+ * (*) ptr + size - 2 in the release variant, the footer is always the last 2
+ * bytes of the block.
+ *
+ * The links and the footer need a capacity of at least MIN_CAPACITY. A block
+ * is only split when the rest can hold a block of its own (SPLIT_MIN bytes:
+ * header + MIN_CAPACITY + buffer).
+ */
+#if !MALLOC_TLSF
+#define BUCKETS 11
+#endif
+#if MALLOC_RELEASE
+#define MIN_CAPACITY 6
+#else
+#define MIN_CAPACITY 5
+#endif
+#define SPLIT_MIN (MIN_CAPACITY + BLOCK_OVERHEAD)
+
+#if MALLOC_TLSF
+/**
+ * @implementation_details:
+ * the TLSF index. The first level splits the capacities into powers of two
+ * like the lists above (2^2 ... 2^10, the smallest capacity is 5), the second
+ * level splits every power of two into SL_COUNT bins of equal width:
+ *
+ *   first level 4: capacities 16 - 31, bins 16 - 19, 20 - 23, 24 - 27, 28 - 31
+ *
+ * One bit per bin says whether its list is empty (sl_bitmap, one byte per
+ * first level) and one bit per first level whether any of its bins has a block
+ * (fl_bitmap). Finding a non-empty bin is two bitmap lookups, never a search
+ * through lists.
+ */
+#define FL_SHIFT 2
+#define FL_COUNT 9
+#define SL_BITS 2
+#define SL_COUNT (1 << SL_BITS)
+#define BUCKETS (FL_COUNT * SL_COUNT)
+static uint16_t fl_bitmap = 0;
+static uint8_t sl_bitmap[FL_COUNT];
+#endif
+static uint16_t free_lists[BUCKETS];
+
+/**
+ * @implementation_details:
+ * the sum of the capacities of all blocks on the free lists, kept up to date
+ * by list_push and list_remove for heap_fragmentation.
+ */
+static uint16_t free_bytes = 0;
+
+/**
+ * @implementation_details:
+ * counters for heap_stats, updated as blocks change state so the statistics
+ * never have to walk the heap. __HEAP_PEAK is the highest __HEAP_END so far.
+ */
+static uint16_t free_blocks = 0;
+static uint16_t used_bytes = 0;
+static uint16_t used_blocks = 0;
+static uint8_ptr_t __HEAP_PEAK = 0x0000;
+
+/**
+ * @implementation_details:
+ * called through panic when the canary is gone. Set with
+ * heap_set_panic_handler, the default stops the microcontroller.
+ */
+static void heap_halt(void_ptr_t message);
+static void (*panic_handler)(void_ptr_t) = heap_halt;
 
 /**
  * @function:
@@ -83,8 +251,14 @@ static uint8_t active_block(uint8_ptr_t ptr) {
  * @return: true if the block is allocated, false otherwise
  */
 static uint8_t allocated_block(uint8_ptr_t ptr) {
+#if MALLOC_RELEASE
+  // no magic number to check, trust the pointer
+  (void)ptr;
+  return 1;
+#else
   uint16_ptr_t header = (uint16_ptr_t)(ptr - 2);
   return (*header & ALLOCATED_MASK) == MAGIC_NUMBER;
+#endif
 }
 
 /**
@@ -93,7 +267,8 @@ static uint8_t allocated_block(uint8_ptr_t ptr) {
  * @arguments: uint8_ptr_t ptr
  * @return: uint16_t
  * @description:
- * This function will return the size of the block pointed to by ptr.
+ * This function will return the size (capacity) of the block pointed to by
+ * ptr.
  */
 static uint16_t block_size(uint8_ptr_t ptr) {
   uint16_ptr_t header = (uint16_ptr_t)(ptr - 2);
@@ -106,70 +281,612 @@ static uint16_t block_size(uint8_ptr_t ptr) {
  * @arguments: uint8_ptr_t ptr
  * @return: uint8_ptr_t
  * @description:
- * This function will return a pointer to the next valid block address in the
- * heap given some allocated address. It will ensure two bytes preceding the
- * returned address are free for the header.
+ * This function will return a pointer to the payload of the block that
+ * follows the block pointed to by ptr in the heap. The capacity is always odd
+ * (even without the guard byte) so payload + capacity + guard byte ends on an
+ * even address, the next header starts there.
  */
 static uint8_ptr_t jump_to_next_block(uint8_ptr_t ptr) {
-  uint16_t block_sz = block_size(ptr);
-  //+1 for buffer
-  // +2 mod 2 for aligned address
-  // +2 for header
-  return (uint8_ptr_t)(((uint16_t)ptr + (uint16_t)block_size + 1 + 2) % 2) + 2;
+  // the guard byte, then the header of the next block
+  return ptr + block_size(ptr) + BLOCK_OVERHEAD;
+}
+
+/**
+ * @function:
+ * block_capacity
+ * @arguments: uint16_t size
+ * @return: uint16_t
+ * @description:
+ * the capacity of a block that can hold size bytes. It is odd so the block
+ * (header + capacity + guard byte) stays 2 byte aligned without padding, and
+ * at least MIN_CAPACITY so the freed block can hold its list link. Without
+ * the guard byte it is even for the same reason.
+ */
+static uint16_t block_capacity(uint16_t size) {
+#if MALLOC_RELEASE
+  uint16_t capacity = (size + 1) & ~1;
+#else
+  uint16_t capacity = size | 1;
+#endif
+  return capacity < MIN_CAPACITY ? MIN_CAPACITY : capacity;
 }
 
+/**
+ * @function:
+ * size_class
+ * @arguments: uint16_t capacity
+ * @return: uint8_t
+ * @description:
+ * the bucket of a free block, floor(log2(capacity)). At most BUCKETS - 1
+ * iterations.
+ */
+#if MALLOC_TLSF
+/**
+ * @function:
+ * floor_log2 / lowest_bit
+ * @arguments: uint16_t value (not 0)
+ * @return: uint8_t
+ * @description:
+ * the index of the highest / lowest set bit. A fixed sequence of 4 tests
+ * (binary search) so the time does not depend on the value.
+ */
+static uint8_t floor_log2(uint16_t value) {
+  uint8_t bit = 0;
+  if (value >= 0x0100) {
+    value >>= 8;
+    bit += 8;
+  }
+  if (value >= 0x0010) {
+    value >>= 4;
+    bit += 4;
+  }
+  if (value >= 0x0004) {
+    value >>= 2;
+    bit += 2;
+  }
+  if (value >= 0x0002) {
+    bit += 1;
+  }
+  return bit;
+}
+
+static uint8_t lowest_bit(uint16_t value) {
+  uint8_t bit = 0;
+  if ((value & 0x00ff) == 0) {
+    value >>= 8;
+    bit += 8;
+  }
+  if ((value & 0x000f) == 0) {
+    value >>= 4;
+    bit += 4;
+  }
+  if ((value & 0x0003) == 0) {
+    value >>= 2;
+    bit += 2;
+  }
+  if ((value & 0x0001) == 0) {
+    bit += 1;
+  }
+  return bit;
+}
+
+/**
+ * @function:
+ * size_class
+ * @arguments: uint16_t capacity
+ * @return: uint8_t
+ * @description:
+ * the bin of a free block: first level * SL_COUNT + second level
+ */
+static uint8_t size_class(uint16_t capacity) {
+  uint8_t level = floor_log2(capacity);
+  uint8_t bin = (capacity >> (level - SL_BITS)) & (SL_COUNT - 1);
+  return (level - FL_SHIFT) * SL_COUNT + bin;
+}
+
+/**
+ * @function:
+ * bin_filled / bin_emptied
+ * @arguments: uint8_t bucket
+ * @description:
+ * keep the bitmaps in sync with the lists
+ */
+static void bin_filled(uint8_t bucket) {
+  sl_bitmap[bucket >> SL_BITS] |= 1 << (bucket & (SL_COUNT - 1));
+  fl_bitmap |= 1 << (bucket >> SL_BITS);
+}
+
+static void bin_emptied(uint8_t bucket) {
+  sl_bitmap[bucket >> SL_BITS] &= ~(1 << (bucket & (SL_COUNT - 1)));
+  if (sl_bitmap[bucket >> SL_BITS] == 0) {
+    fl_bitmap &= ~(1 << (bucket >> SL_BITS));
+  }
+}
+#else
+static uint8_t size_class(uint16_t capacity) {
+  uint8_t bucket = 0;
+  while (capacity > 1) {
+    capacity >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+#define bin_filled(bucket)
+#define bin_emptied(bucket)
+#endif
+
+/**
+ * @function:
+ * block_offset / offset_block
+ * @description:
+ * convert between a payload pointer and the offset stored in the free lists
+ */
+static uint16_t block_offset(uint8_ptr_t ptr) {
+  return (uint16_t)(ptr - __HEAP_START);
+}
+
+static uint8_ptr_t offset_block(uint16_t offset) {
+  return __HEAP_START + offset;
+}
+
+/**
+ * @function:
+ * next_link / prev_link
+ * @description:
+ * the list links stored in the payload of a free block
+ */
+static uint16_ptr_t next_link(uint8_ptr_t ptr) { return (uint16_ptr_t)ptr; }
+
+static uint16_ptr_t prev_link(uint8_ptr_t ptr) {
+  return (uint16_ptr_t)(ptr + 2);
+}
+
+/**
+ * @function:
+ * list_push
+ * @arguments: uint8_ptr_t ptr
+ * @description:
+ * put a free block at the head of the list of its size class
+ */
+static void list_push(uint8_ptr_t ptr) {
+  uint16_t capacity = block_size(ptr);
+  uint8_t bucket = size_class(capacity);
+  uint16_t head = free_lists[bucket];
+  *next_link(ptr) = head;
+  *prev_link(ptr) = 0;
+  if (head != 0) {
+    *prev_link(offset_block(head)) = block_offset(ptr);
+  }
+  free_lists[bucket] = block_offset(ptr);
+  bin_filled(bucket);
+  free_bytes += capacity;
+  free_blocks++;
+}
+
+/**
+ * @function:
+ * list_remove
+ * @arguments: uint8_ptr_t ptr
+ * @description:
+ * take a free block off its list, wherever it is in the list
+ */
+static void list_remove(uint8_ptr_t ptr) {
+  uint16_t capacity = block_size(ptr);
+  uint16_t next = *next_link(ptr);
+  uint16_t prev = *prev_link(ptr);
+  if (prev != 0) {
+    *next_link(offset_block(prev)) = next;
+  } else {
+    uint8_t bucket = size_class(capacity);
+    free_lists[bucket] = next;
+    if (next == 0) {
+      bin_emptied(bucket);
+    }
+  }
+  if (next != 0) {
+    *prev_link(offset_block(next)) = prev;
+  }
+  free_bytes -= capacity;
+  free_blocks--;
+}
+
+/**
+ * @function:
+ * mark_free
+ * @arguments: uint8_ptr_t ptr, uint16_t capacity
+ * @description:
+ * write the header and the footer of a free block and put it on its list.
+ * PREV_FREE is clear. The block before a free block is free only when the two
+ * together would pass MAX_CAPACITY (see release_block), the caller sets
+ * PREV_FREE again in that case.
+ */
+static void mark_free(uint8_ptr_t ptr, uint16_t capacity) {
+  *(uint16_ptr_t)(ptr - 2) = (capacity << SIZE_SHIFT) | HEADER_MAGIC;
+  *(uint16_ptr_t)(ptr + capacity + GUARD_BYTES - 2) = capacity;
+  list_push(ptr);
+}
+
+/**
+ * @function:
+ * set_prev_free
+ * @arguments: uint8_ptr_t ptr, uint8_t free
+ * @description:
+ * update PREV_FREE in the header of the block that follows ptr, if there is
+ * one (the last block has no successor)
+ */
+static void set_prev_free(uint8_ptr_t ptr, uint8_t free) {
+  uint8_ptr_t next = jump_to_next_block(ptr);
+  if (next - 2 >= __HEAP_END) {
+    return;
+  }
+  if (free) {
+    *(uint16_ptr_t)(next - 2) |= PREV_FREE_MASK;
+  } else {
+    *(uint16_ptr_t)(next - 2) &= ~PREV_FREE_MASK;
+  }
+}
+
+/**
+ * @function:
+ * heap_halt
+ * @arguments: void_ptr_t message
+ * @return: does not return
+ * @description:
+ * the default panic handler: the heap can not be trusted anymore, stop with
+ * interrupts disabled so nothing else runs on top of it.
+ */
+static void heap_halt(void_ptr_t message) {
+  (void)message;
+  cli();
+  while (1) {
+  }
+}
+
+/**
+ * @function:
+ * canary
+ * @return: the canary word at __HEAP_LIMIT. volatile, heap_check may run in
+ * an interrupt and the stack writes it behind the compiler's back.
+ */
+static uint16_t canary() { return *(volatile uint16_t *)__HEAP_LIMIT; }
+
 /**
  * @function:
  * check_stack_heap_collision
  * @arguments: void
  * @return: void
  * @description:
- * This function will check if the stack and the heap have collided. We will
- * call this function everytime we allocate memory/free memory. This will
- * helps us out a little when it comes to this issue.
+ * This function will check if the stack and the heap have collided. We call it
+ * everytime we allocate memory/free memory. The fast path is one 16 bit load
+ * from a fixed address and a compare, a handful of cycles. There is no reason
+ * to look at SP: if the stack ever went past the boundary the canary is gone,
+ * even if the stack has shrunk again by now.
  */
 static void check_stack_heap_collision() {
-  // 10 bytte buffer zone
-  uint8_t buffer = 10;
-  // get the stack pointer
-  uint16_t stack_pointer = mergeBytes(SPH, SPL);
-  // if the stack pointer is less than the heap start address we have a
-  // collision
-  if (stack_pointer < (uint16_t)__HEAP_END + buffer) {
-    uint8_t error_msg[20] = "Stack/Heap collision";
+  if (canary() != HEAP_CANARY) {
+    panic(panic_handler, (void_ptr_t) "Stack/Heap collision");
   }
 }
 
+#if MALLOC_TLSF
 /**
  * @implementation_details:
- * now we need to find the first 2 byte aligned address that is not allocated
- * and there is enough space to allocate the requested size.
- */
-static uint8_ptr_t find_free_block(uint16_t size) {
-  // from __HEAP_START find first 2 byte aligned address that is not
-  // allocated, i.e. it does not have the magic number in the allocated
-  // heaader section.
-  uint8_ptr_t current = __HEAP_START;
-  while (current < __HEAP_END) {
-    uint16_ptr_t header = (uint16_ptr_t)current;
-    if (allocated_block(current)) {
-      if (active_block(current)) {
-        // we have found an allocated and active block
-        //  we need to skip this block
-        current = jump_to_next_block(current);
-        continue;
-      } else {
-        // we have found an allocated but inactive block
-        // we can use this block
-        if (block_size(current) >= size) {
-          return current;
-        }
-        current = jump_to_next_block(current);
-        continue;
-      }
+ * TLSF good fit. The request is rounded up to the next bin boundary, then
+ * every block in that bin and in any bin above it is big enough. The first
+ * non-empty bin at or above it comes from the bitmaps: the bins of the same
+ * first level (sl_bitmap), else the lowest non-empty first level above
+ * (fl_bitmap) and its lowest bin. The head of that list is taken.
+ *
+ * @worst_case:
+ * there is no loop whose length depends on the heap. The lookup is 2
+ * floor_log2, at most 2 bitmap lookups (sl_bitmap[first], else fl_bitmap and
+ * sl_bitmap of the level found) with one lowest_bit each, 4 shifts by a
+ * variable count of at most 9 positions and 1 list_remove. allocate_block adds
+ * extend_heap, or the split (release_block of the rest: at most 1 more
+ * list_remove and 1 list_push). free adds at most 2 list_remove and 1
+ * list_push, plus at most 1 list_remove per 1K of heap when the top is given
+ * back (only on a heap larger than MAX_CAPACITY, see release_block). Every
+ * list operation is one size_class (floor_log2 and a shift) and an update of
+ * at most 2 bitmap bytes. See @worst_case in malloc.h for the comparison with
+ * the power of two lists, which are faster on AVR.
+ *
+ * The price is internal fragmentation: a request can be served from a bin a
+ * step above it even though a block of exactly its size is free in its own
+ * bin. With 4 bins per power of two the rounding wastes less than 25%.
+ */
+static uint8_ptr_t find_free_block(uint16_t capacity) {
+  uint8_t level = floor_log2(capacity);
+  capacity += (1 << (level - SL_BITS)) - 1;
+  level = floor_log2(capacity);
+  if (level >= FL_SHIFT + FL_COUNT) {
+    // larger than any bin, only the top of the heap can serve it
+    return 0x0000;
+  }
+  uint8_t first = level - FL_SHIFT;
+  uint8_t second = (capacity >> (level - SL_BITS)) & (SL_COUNT - 1);
+  uint8_t bins = sl_bitmap[first] & (0xff << second);
+  if (bins == 0) {
+    uint16_t levels = fl_bitmap & (0xffff << (first + 1));
+    if (levels == 0) {
+      return 0x0000;
+    }
+    first = lowest_bit(levels);
+    bins = sl_bitmap[first];
+  }
+  uint8_ptr_t block =
+      offset_block(free_lists[first * SL_COUNT + lowest_bit(bins)]);
+  list_remove(block);
+  return block;
+}
+#else
+/**
+ * @implementation_details:
+ * find a block with a capacity of at least capacity bytes and take it off its
+ * free list. Every block in class n has a capacity of at least 2^n, so the
+ * head of any list from the class above the request up is big enough and we
+ * never walk a list. The list of the request's own class may hold blocks that
+ * are too small, we only look at its head. This bounds the search by the
+ * number of buckets no matter how many blocks are free.
+ *
+ * returns 0 if no free block is big enough.
+ */
+static uint8_ptr_t find_free_block(uint16_t capacity) {
+  uint8_t bucket = size_class(capacity);
+  uint16_t offset = free_lists[bucket];
+  if (offset != 0 && block_size(offset_block(offset)) >= capacity) {
+    list_remove(offset_block(offset));
+    return offset_block(offset);
+  }
+  for (bucket++; bucket < BUCKETS; bucket++) {
+    offset = free_lists[bucket];
+    if (offset != 0) {
+      list_remove(offset_block(offset));
+      return offset_block(offset);
+    }
+  }
+  return 0x0000;
+}
+#endif
+
+/**
+ * @implementation_details:
+ * no free block fits, carve a new one from the top of the heap. returns 0 if
+ * the block would cross __HEAP_LIMIT.
+ */
+static uint8_ptr_t extend_heap(uint16_t capacity) {
+  uint8_ptr_t block = __HEAP_END + 2;
+  // the payload and the guard byte must end below the heap limit
+  if (block > __HEAP_LIMIT ||
+      capacity + GUARD_BYTES > (uint16_t)(__HEAP_LIMIT - block)) {
+    return 0x0000;
+  }
+  __HEAP_END = block + capacity + GUARD_BYTES;
+  if (__HEAP_END > __HEAP_PEAK) {
+    __HEAP_PEAK = __HEAP_END;
+  }
+  return block;
+}
+
+/**
+ * @implementation_details:
+ * MALLOC_TRACK=1 (`make clean all MALLOC_TRACK=1` in /utils/) records the
+ * call site of every live block in a side table so heap_leak_report can list
+ * what was never freed. Without it none of this is compiled, the line argument
+ * is ignored and heap_leak_report does not exist.
+ *
+ * An entry is the offset of the payload (0 for an unused entry) and the site
+ * the caller passed as line (MALLOC_SITE packs a file ID and the line). 4
+ * bytes per entry, the block headers do not change. A block allocated while
+ * the table is full is not tracked and counted in track_dropped instead.
+ * free looks its block up with a scan of the table, tracking is a debugging
+ * aid and trades speed for not touching the block layout.
+ */
+#ifndef MALLOC_TRACK
+#define MALLOC_TRACK 0
+#endif
+
+#if MALLOC_TRACK
+#ifndef MALLOC_TRACK_SLOTS
+#define MALLOC_TRACK_SLOTS 32
+#endif
+
+typedef struct {
+  uint16_t offset;
+  uint16_t site;
+} track_entry_t;
+
+static track_entry_t track_table[MALLOC_TRACK_SLOTS];
+static uint16_t track_dropped = 0;
+
+/**
+ * @function:
+ * track_find
+ * @arguments: uint16_t offset
+ * @return: the entry of the block at offset (0 finds a free entry), 0 if
+ * there is none
+ */
+static track_entry_t *track_find(uint16_t offset) {
+  for (uint8_t slot = 0; slot < MALLOC_TRACK_SLOTS; slot++) {
+    if (track_table[slot].offset == offset) {
+      return &track_table[slot];
+    }
+  }
+  return 0x0000;
+}
+
+/**
+ * @function:
+ * track_add / track_site / track_remove
+ * @description:
+ * record a new block, move a block to a new site (realloc in place) and
+ * forget a freed block
+ */
+static void track_add(uint8_ptr_t ptr, uint16_t site) {
+  track_entry_t *entry = track_find(0);
+  if (entry == 0x0000) {
+    track_dropped++;
+    return;
+  }
+  entry->offset = block_offset(ptr);
+  entry->site = site;
+}
+
+static void track_site(uint8_ptr_t ptr, uint16_t site) {
+  track_entry_t *entry = track_find(block_offset(ptr));
+  if (entry != 0x0000) {
+    entry->site = site;
+  }
+}
+
+static void track_remove(uint8_ptr_t ptr) {
+  track_entry_t *entry = track_find(block_offset(ptr));
+  if (entry != 0x0000) {
+    entry->offset = 0;
+  } else if (track_dropped > 0) {
+    // one of the blocks that did not fit in the table
+    track_dropped--;
+  }
+}
+#else
+// use the site anyway, line would be an unused parameter of allocate_block
+// and resize_in_place
+#define track_add(ptr, site) ((void)(site))
+#define track_site(ptr, site) ((void)(site))
+#define track_remove(ptr)
+#endif
+
+/**
+ * @implementation_details:
+ * MALLOC_ISR_SAFE=1 makes the allocator safe to call from interrupt handlers.
+ * The work on the headers, the free lists, __HEAP_END and the counters runs
+ * with interrupts disabled: CRITICAL_ENTER saves SREG in sreg and clears the
+ * I bit, CRITICAL_EXIT writes SREG back. Writing SREG back instead of sei()
+ * keeps interrupts off for a caller that had them off (an ISR, or main inside
+ * its own critical section). The memory clobber keeps the compiler from
+ * moving heap stores past the restore. Work on the payload (the copy of
+ * realloc, the zeroing of calloc) runs with interrupts enabled again.
+ *
+ * The ISR reserve is a pool (pool.c) of MALLOC_ISR_RESERVE_SLOTS slots of
+ * MALLOC_ISR_RESERVE_SIZE bytes next to the heap. Only malloc_from_isr draws
+ * from it, and only in interrupt context, so main can use up the heap without
+ * leaving a receive interrupt without a buffer. free tells the slots apart
+ * from heap blocks by their address.
+ */
+#ifndef MALLOC_ISR_SAFE
+#define MALLOC_ISR_SAFE 0
+#endif
+
+#if MALLOC_ISR_SAFE
+#define CRITICAL_ENTER()                                                       \
+  uint8_t sreg = SREG;                                                         \
+  cli()
+#define CRITICAL_EXIT()                                                        \
+  do {                                                                         \
+    asm volatile("" ::: "memory");                                             \
+    SREG = sreg;                                                               \
+  } while (0)
+
+#ifndef MALLOC_ISR_RESERVE_SLOTS
+#define MALLOC_ISR_RESERVE_SLOTS 4
+#endif
+#ifndef MALLOC_ISR_RESERVE_SIZE
+#define MALLOC_ISR_RESERVE_SIZE 32
+#endif
+
+static uint8_t isr_region[POOL_REGION_SIZE(MALLOC_ISR_RESERVE_SIZE,
+                                           MALLOC_ISR_RESERVE_SLOTS)]
+    __attribute__((aligned(2)));
+static uint8_t isr_map[POOL_MAP_SIZE(MALLOC_ISR_RESERVE_SLOTS)];
+static pool_t isr_reserve;
+
+/**
+ * @function:
+ * reserve_block
+ * @arguments: uint8_ptr_t ptr
+ * @return: true if ptr points into the ISR reserve
+ */
+static uint8_t reserve_block(uint8_ptr_t ptr) {
+  return ptr >= isr_region && ptr < isr_region + sizeof(isr_region);
+}
+#else
+#define CRITICAL_ENTER()
+#define CRITICAL_EXIT()
+#endif
+
+/**
+ * @function:
+ * initialize_heap
+ * @arguments: void
+ * @return: void
+ * @description:
+ * the heap is empty until the first call into this module, __HEAP_START is
+ * only known at link time so __HEAP_END can not be initialized statically.
+ */
+static void initialize_heap() {
+  if (__HEAP_END == 0x0000) {
+    __HEAP_END = __HEAP_START;
+    __HEAP_PEAK = __HEAP_START;
+#if MALLOC_ISR_SAFE
+    pool_init(&isr_reserve, isr_region, isr_map, MALLOC_ISR_RESERVE_SIZE,
+              MALLOC_ISR_RESERVE_SLOTS);
+#endif
+  }
+}
+
+/**
+ * @function:
+ * release_block
+ * @arguments: uint8_ptr_t ptr, uint16_t capacity
+ * @return: void
+ * @description:
+ * turn the block at ptr into free memory. It merges the block with a free
+ * block right before or after it and pushes the result on the free list of
+ * its size class. A free block at the top of the heap lowers __HEAP_END. Only
+ * the PREV_FREE bit of the header at ptr is read, the rest may be stale.
+ *
+ * A merge that would pass MAX_CAPACITY (only possible on a heap larger than
+ * 2K, e.g. the atmega2560) is skipped. The two free blocks then stay side by
+ * side and the second one keeps PREV_FREE set, so the next free of a block
+ * after them still finds its free neighbour.
+ */
+static void release_block(uint8_ptr_t ptr, uint16_t capacity) {
+  // the header stays behind inside a merged block, it must not look active or
+  // a second free of ptr would pass check_block
+  *(uint16_ptr_t)(ptr - 2) &= ~ACTIVE_MASK;
+  // merge with the previous block, its footer sits right before our header
+  if (*(uint16_ptr_t)(ptr - 2) & PREV_FREE_MASK) {
+    uint16_t prev_capacity = *(uint16_ptr_t)(ptr - 4);
+    if (prev_capacity + BLOCK_OVERHEAD + capacity <= MAX_CAPACITY) {
+      list_remove(ptr - BLOCK_OVERHEAD - prev_capacity);
+      ptr -= BLOCK_OVERHEAD + prev_capacity;
+      capacity += BLOCK_OVERHEAD + prev_capacity;
+    }
+  }
+  // merge with the next block
+  uint8_ptr_t next = ptr + capacity + BLOCK_OVERHEAD;
+  if (next - 2 < __HEAP_END && !active_block(next) &&
+      capacity + BLOCK_OVERHEAD + block_size(next) <= MAX_CAPACITY) {
+    list_remove(next);
+    capacity += BLOCK_OVERHEAD + block_size(next);
+  }
+
+  // the header at ptr is ours or the one of the block we merged into, its
+  // PREV_FREE is set if a merge before it was skipped
+  uint16_t prev_free = *(uint16_ptr_t)(ptr - 2) & PREV_FREE_MASK;
+  if (ptr + capacity + GUARD_BYTES == __HEAP_END) {
+    // the free block is the top of the heap, give it back instead. So are
+    // the free blocks right before it that a skipped merge left behind.
+    while (*(uint16_ptr_t)(ptr - 2) & PREV_FREE_MASK) {
+      ptr -= BLOCK_OVERHEAD + *(uint16_ptr_t)(ptr - 4);
+      list_remove(ptr);
     }
+    __HEAP_END = ptr - 2;
+  } else {
+    mark_free(ptr, capacity);
+    *(uint16_ptr_t)(ptr - 2) |= prev_free;
+    set_prev_free(ptr, 1);
   }
-  return current;
 }
 
 /**
@@ -183,60 +900,123 @@ static uint8_ptr_t find_free_block(uint16_t size) {
  */
 static void initialize_block(uint8_ptr_t block, uint16_t size) {
   uint16_ptr_t header = (uint16_ptr_t)(block - 2);
-  // set the size
-  *header = size << SIZE_SHIFT;
-  // set the allocated flag
-  *header |= MAGIC_NUMBER;
-  // set the active flag
-  *header |= 1 << ACTIVE_SHIFT;
+  // set the size, the allocated flag and the active flag
+  *header = (size << SIZE_SHIFT) | HEADER_MAGIC | (1 << ACTIVE_SHIFT);
+#if !MALLOC_RELEASE
   // set the buffer too the magic number
   *(block + size) = MAGIC_NUMBER;
+#endif
 }
 
-int malloc(uint16_t size, uint8_ptr_ptr_t ptr, uint16_t line) {
+/**
+ * @function:
+ * allocate_block
+ * @arguments: uint16_t size, uint8_ptr_ptr_t ptr, uint16_t line
+ * @return: 0 on success, -1 with ERNO set
+ * @description:
+ * malloc without the critical section, see malloc.h
+ */
+static int allocate_block(uint16_t size, uint8_ptr_ptr_t ptr, uint16_t line) {
   // if size is 0 we will panic
   if (size == 0) {
     return -1;
   }
+  if (size > MAX_CAPACITY) {
+    ERNO = MEMORY_ALLOCATION_FAILED;
+    return -1;
+  }
 
   // check if heap is initialized
-  if (__HEAP_END == 0x0000) {
-    __HEAP_END = __HEAP_START;
-  }
+  initialize_heap();
 
   // check for stack/heap collision
   check_stack_heap_collision();
 
-  // find a free block
-  uint8_ptr_t free_block = find_free_block(size);
+  // reuse a free block, otherwise grow the heap
+  uint16_t capacity = block_capacity(size);
+  uint8_ptr_t block = find_free_block(capacity);
+  // a free block can follow another one, see release_block
+  uint16_t prev_free = 0;
+  if (block != 0x0000) {
+    uint16_t found = block_size(block);
+    prev_free = *(uint16_ptr_t)(block - 2) & PREV_FREE_MASK;
+    if (found - capacity >= SPLIT_MIN) {
+      // split, the rest becomes a free block of its own: an inactive header
+      // with PREV_FREE clear, the block before it is ours. release_block
+      // merges it with a free block after it.
+      uint8_ptr_t rest = block + capacity + BLOCK_OVERHEAD;
+      *(uint16_ptr_t)(rest - 2) =
+          ((found - capacity - BLOCK_OVERHEAD) << SIZE_SHIFT) | HEADER_MAGIC;
+      release_block(rest, found - capacity - BLOCK_OVERHEAD);
+    } else {
+      // use the block whole, it is no longer free for the block after it
+      capacity = found;
+      set_prev_free(block, 0);
+    }
+  } else {
+    block = extend_heap(capacity);
+    if (block == 0x0000) {
+      ERNO = MEMORY_ALLOCATION_FAILED;
+      return -1;
+    }
+  }
 
   // initialize the block
-  initialize_block(free_block, size);
+  initialize_block(block, capacity);
+  *(uint16_ptr_t)(block - 2) |= prev_free;
+  used_bytes += capacity;
+  used_blocks++;
+  track_add(block, line);
 
   // set the ptr to the beginning of the payload block
-  *ptr = free_block;
-
-  // update the heap end
-  __HEAP_END = jump_to_next_block(free_block);
+  *ptr = block;
 
   return 0;
 }
 
+int malloc(uint16_t size, uint8_ptr_ptr_t ptr, uint16_t line) {
+  CRITICAL_ENTER();
+  int result = allocate_block(size, ptr, line);
+  CRITICAL_EXIT();
+  return result;
+}
+
+#if MALLOC_ISR_SAFE
+int malloc_from_isr(uint16_t size, uint8_ptr_ptr_t ptr, uint16_t line) {
+  CRITICAL_ENTER();
+  int result = allocate_block(size, ptr, line);
+  // the reserve is for interrupt context only, the I bit is clear in an ISR.
+  // It is clear in a critical section of main too, see malloc.h
+  if (result != 0 && size != 0 && size <= MALLOC_ISR_RESERVE_SIZE &&
+      (sreg & (1 << SREG7)) == 0) {
+    result = pool_alloc(&isr_reserve, ptr);
+  }
+  CRITICAL_EXIT();
+  return result;
+}
+
+uint8_t heap_isr_reserve_available() {
+  CRITICAL_ENTER();
+  initialize_heap();
+  uint8_t available = pool_available(&isr_reserve);
+  CRITICAL_EXIT();
+  return available;
+}
+#endif
+
 /**
  * @function:
- * free
+ * check_block
  * @arguments: uint8_ptr_t ptr
- * @return: void
+ * @return: 0 if ptr is an allocated block returned by malloc, else -1 with
+ * ERNO set
  * @description:
- * This function will free the block pointed to by ptr. It will set the active
- * flag to 0.
+ * the checks free and realloc run before they touch a block
  */
-int free(uint8_ptr_t ptr) {
-  // ensure no stack/heap collision has occured
-  check_stack_heap_collision();
-  // get the header
-  uint16_ptr_t header = (uint16_ptr_t)(ptr - 2);
-  if (!allocated_block(ptr)) {
+static int check_block(uint8_ptr_t ptr) {
+  // a pointer outside the heap (or odd) was never returned by malloc
+  if (ptr < __HEAP_START + 2 || ptr >= __HEAP_END ||
+      (block_offset(ptr) & 1) != 0 || !allocated_block(ptr)) {
     ERNO = ATTEMPTED_FREE_UNALLOCATED_BLOCK;
     return -1;
 
@@ -244,13 +1024,442 @@ int free(uint8_ptr_t ptr) {
     ERNO = DOUBLE_FREE;
     return -1;
 
-  } else {
-    // set the active flag to 0
-    *(uint16_ptr_t)(ptr - 2) &= ~(1 << ACTIVE_SHIFT);
   }
+#if !MALLOC_RELEASE
+  if (*(ptr + block_size(ptr)) != MAGIC_NUMBER) {
+    // the block stays allocated, its neighbour may be damaged
+    ERNO = OUT_OF_BOUNDS_WRITE;
+    return -1;
+  }
+#endif
   return 0;
 }
 
+/**
+ * @function:
+ * free_block
+ * @arguments: uint8_ptr_t ptr
+ * @return: 0 on success, -1 with ERNO set
+ * @description:
+ * This function will free the block pointed to by ptr, see release_block.
+ * free without the critical section.
+ */
+static int free_block(uint8_ptr_t ptr) {
+  // ensure no stack/heap collision has occured
+  initialize_heap();
+  check_stack_heap_collision();
+#if MALLOC_ISR_SAFE
+  if (reserve_block(ptr)) {
+    if (pool_free(&isr_reserve, ptr) != 0) {
+      ERNO = INVALID_RESERVE_FREE;
+      return -1;
+    }
+    return 0;
+  }
+#endif
+  if (check_block(ptr) != 0) {
+    return -1;
+  }
+
+  uint16_t capacity = block_size(ptr);
+  used_bytes -= capacity;
+  used_blocks--;
+  track_remove(ptr);
+  release_block(ptr, capacity);
+  return 0;
+}
+
+int free(uint8_ptr_t ptr) {
+  CRITICAL_ENTER();
+  int result = free_block(ptr);
+  CRITICAL_EXIT();
+  return result;
+}
+
+/**
+ * @function:
+ * resize_block
+ * @arguments: uint8_ptr_t ptr, uint16_t capacity, uint16_t new_capacity
+ * @return: void
+ * @description:
+ * rewrite the header and guard byte of the allocated block at ptr for
+ * new_capacity. PREV_FREE is kept, the block before ptr did not change.
+ */
+static void resize_block(uint8_ptr_t ptr, uint16_t capacity,
+                         uint16_t new_capacity) {
+  uint16_t prev_free = *(uint16_ptr_t)(ptr - 2) & PREV_FREE_MASK;
+  initialize_block(ptr, new_capacity);
+  *(uint16_ptr_t)(ptr - 2) |= prev_free;
+  used_bytes += new_capacity - capacity;
+}
+
+/**
+ * @function:
+ * split_tail
+ * @arguments: uint8_ptr_t ptr, uint16_t capacity
+ * @return: void
+ * @description:
+ * the allocated block at ptr ends capacity bytes in. The bytes from there up
+ * to next (the payload of the following block or __HEAP_END + 2) are not used
+ * anymore. Release them if they can hold a block of their own, otherwise the
+ * block keeps them.
+ *
+ * returns the capacity the block at ptr ends up with.
+ */
+static uint16_t split_tail(uint8_ptr_t ptr, uint16_t capacity,
+                           uint8_ptr_t next) {
+  uint16_t rest = (uint16_t)(next - ptr) - BLOCK_OVERHEAD - capacity;
+  if (rest < SPLIT_MIN) {
+    return capacity + rest;
+  }
+  uint8_ptr_t tail = ptr + capacity + BLOCK_OVERHEAD;
+  // an inactive header with PREV_FREE clear, the block before it is ours
+  *(uint16_ptr_t)(tail - 2) =
+      ((rest - BLOCK_OVERHEAD) << SIZE_SHIFT) | HEADER_MAGIC;
+  release_block(tail, rest - BLOCK_OVERHEAD);
+  return capacity;
+}
+
+/**
+ * @function:
+ * copy_words / zero_words
+ * @arguments: destination, source, bytes
+ * @description:
+ * copy or clear bytes 2 at a time. Payloads are 2 byte aligned and capacities
+ * cover whole words except for the last byte of an odd capacity.
+ */
+static void copy_words(uint8_ptr_t destination, uint8_ptr_t source,
+                       uint16_t bytes) {
+  uint16_ptr_t to = (uint16_ptr_t)destination;
+  uint16_ptr_t from = (uint16_ptr_t)source;
+  for (uint16_t words = bytes >> 1; words > 0; words--) {
+    *to++ = *from++;
+  }
+  if (bytes & 1) {
+    *(uint8_ptr_t)to = *(uint8_ptr_t)from;
+  }
+}
+
+static void zero_words(uint8_ptr_t destination, uint16_t bytes) {
+  uint16_ptr_t to = (uint16_ptr_t)destination;
+  for (uint16_t words = bytes >> 1; words > 0; words--) {
+    *to++ = 0;
+  }
+  if (bytes & 1) {
+    *(uint8_ptr_t)to = 0;
+  }
+}
+
+/**
+ * @function:
+ * resize_in_place
+ * @arguments: uint8_ptr_t block, uint16_t size, uint16_t line
+ * @return: 0 when the block now holds size bytes, -1 with ERNO set, or
+ * MUST_MOVE when there is no room next to the block
+ * @description:
+ * the part of realloc that touches the heap, without the critical section
+ */
+#define MUST_MOVE 1
+
+static int resize_in_place(uint8_ptr_t block, uint16_t size, uint16_t line) {
+  initialize_heap();
+  check_stack_heap_collision();
+  if (check_block(block) != 0) {
+    return -1;
+  }
+  if (size > MAX_CAPACITY) {
+    ERNO = MEMORY_ALLOCATION_FAILED;
+    return -1;
+  }
+
+  uint16_t capacity = block_size(block);
+  uint16_t new_capacity = block_capacity(size);
+  uint8_ptr_t next = block + capacity + BLOCK_OVERHEAD;
+
+  if (new_capacity <= capacity) {
+    // shrink, give the tail back if it is big enough for a block
+    resize_block(block, capacity, split_tail(block, new_capacity, next));
+    track_site(block, line);
+    return 0;
+  }
+
+  if (next - 2 == __HEAP_END) {
+    // the top block, grow into the unused space below __HEAP_LIMIT
+    if (new_capacity + GUARD_BYTES <= (uint16_t)(__HEAP_LIMIT - block)) {
+      __HEAP_END = block + new_capacity + GUARD_BYTES;
+      if (__HEAP_END > __HEAP_PEAK) {
+        __HEAP_PEAK = __HEAP_END;
+      }
+      resize_block(block, capacity, new_capacity);
+      track_site(block, line);
+      return 0;
+    }
+  } else if (!active_block(next) &&
+             capacity + BLOCK_OVERHEAD + block_size(next) >= new_capacity &&
+             capacity + BLOCK_OVERHEAD + block_size(next) <= MAX_CAPACITY) {
+    // the next block is free and big enough, take it over. A free block is
+    // never the top block, so there is a block after it.
+    uint8_ptr_t after = jump_to_next_block(next);
+    list_remove(next);
+    // the block after it had PREV_FREE set, split_tail sets it again if a
+    // free tail is left
+    *(uint16_ptr_t)(after - 2) &= ~PREV_FREE_MASK;
+    resize_block(block, capacity, split_tail(block, new_capacity, after));
+    track_site(block, line);
+    return 0;
+  }
+  return MUST_MOVE;
+}
+
+int realloc(uint8_ptr_ptr_t ptr, uint16_t size, uint16_t line) {
+  if (*ptr == 0x0000) {
+    return malloc(size, ptr, line);
+  }
+  if (size == 0) {
+    if (free(*ptr) != 0) {
+      return -1;
+    }
+    *ptr = 0x0000;
+    return 0;
+  }
+  CRITICAL_ENTER();
+  int result = resize_in_place(*ptr, size, line);
+  CRITICAL_EXIT();
+  if (result != MUST_MOVE) {
+    return result;
+  }
+
+  // no room next to the block, move it
+  uint8_ptr_t moved;
+  if (malloc(size, &moved, line) != 0) {
+    // the old block is still valid
+    return -1;
+  }
+  // the old block is still ours, the copy runs with interrupts enabled
+  copy_words(moved, *ptr, block_size(*ptr));
+  free(*ptr);
+  *ptr = moved;
+  return 0;
+}
+
+int calloc(uint16_t count, uint16_t size, uint8_ptr_ptr_t ptr, uint16_t line) {
+  // count * size must fit in 16 bits
+  if (size != 0 && count > divide(0xffff, size)) {
+    ERNO = MEMORY_ALLOCATION_FAILED;
+    return -1;
+  }
+  if (malloc(count * size, ptr, line) != 0) {
+    return -1;
+  }
+  zero_words(*ptr, count * size);
+  return 0;
+}
+
+/**
+ * @function:
+ * largest_free_block
+ * @arguments: void
+ * @return: uint16_t
+ * @description:
+ * the capacity of the largest block on the free lists, 0 if there is none.
+ * Only the list of the highest non-empty size class is walked, the largest
+ * free block is on it. That list can hold every free block, heap_stats runs
+ * the walk with interrupts disabled (see @interrupt_safety in malloc.h).
+ */
+static uint16_t largest_free_block() {
+  uint16_t largest = 0;
+  uint8_t bucket = BUCKETS;
+  while (bucket > 0 && free_lists[bucket - 1] == 0) {
+    bucket--;
+  }
+  if (bucket > 0) {
+    for (uint16_t offset = free_lists[bucket - 1]; offset != 0;
+         offset = *next_link(offset_block(offset))) {
+      if (block_size(offset_block(offset)) > largest) {
+        largest = block_size(offset_block(offset));
+      }
+    }
+  }
+  return largest;
+}
+
+/**
+ * @function:
+ * top_capacity
+ * @arguments: void
+ * @return: uint16_t
+ * @description:
+ * the largest capacity extend_heap can carve from the unused space between
+ * __HEAP_END and __HEAP_LIMIT. A new block needs its header and guard byte
+ * there too, and its capacity has the parity of the variant. 0 if no block
+ * fits.
+ */
+static uint16_t top_capacity() {
+  uint16_t top = (uint16_t)(__HEAP_LIMIT - __HEAP_END);
+  if (top < BLOCK_OVERHEAD + MIN_CAPACITY) {
+    return 0;
+  }
+  top -= BLOCK_OVERHEAD;
+#if MALLOC_RELEASE
+  top &= ~1;
+#else
+  top = (top - 1) | 1;
+#endif
+  return top > MAX_CAPACITY ? MAX_CAPACITY : top;
+}
+
+/**
+ * @function:
+ * fragmentation
+ * @arguments: uint16_t total, uint16_t largest
+ * @return: uint8_t
+ * @description:
+ * percentage of total that is not part of largest, without 32 bit math
+ */
+static uint8_t fragmentation(uint16_t total, uint16_t largest) {
+  if (total == 0) {
+    return 0;
+  }
+  // scale down so (total - largest) * 100 fits in 16 bits
+  uint16_t scattered = total - largest;
+  while (total > 655) {
+    total >>= 1;
+    scattered >>= 1;
+  }
+  return (uint8_t)divide(scattered * 100, total);
+}
+
+/**
+ * @function:
+ * heap_fragmentation
+ * @arguments: void
+ * @return: uint8_t
+ * @description:
+ * percentage of the free memory that is not part of the largest free area.
+ * The unused space between __HEAP_END and __HEAP_LIMIT counts as one free
+ * area.
+ */
+uint8_t heap_fragmentation() {
+  heap_stats_t stats;
+  heap_stats(&stats);
+  return stats.fragmentation;
+}
+
+void heap_stats(heap_stats_t *stats) {
+  CRITICAL_ENTER();
+  initialize_heap();
+  uint16_t top = top_capacity();
+  uint16_t largest = largest_free_block();
+  stats->used_bytes = used_bytes;
+  stats->used_blocks = used_blocks;
+  stats->free_bytes = free_bytes + top;
+  stats->free_blocks = free_blocks;
+  stats->largest_free = largest > top ? largest : top;
+  stats->heap_end = (uint16_t)__HEAP_END;
+  stats->peak_end = (uint16_t)__HEAP_PEAK;
+  CRITICAL_EXIT();
+  // the division works on the snapshot, it runs with interrupts enabled
+  stats->fragmentation =
+      fragmentation(stats->free_bytes, stats->largest_free);
+}
+
+void heap_dump() {
+  initialize_heap();
+  usart0_transmit_bytes_P(PSTR("heap "));
+  usart0_transmit_hex16((uint16_t)__HEAP_START);
+  usart0_transmit_bytes_P(PSTR(" - "));
+  usart0_transmit_hex16((uint16_t)__HEAP_LIMIT);
+  usart0_transmit_byte(NEW_LINE);
+  usart0_transmit_byte(CARRIAGE_RETURN);
+  // every block starts where the one before it ends
+  for (uint8_ptr_t ptr = __HEAP_START + 2; ptr - 2 < __HEAP_END;
+       ptr = jump_to_next_block(ptr)) {
+    usart0_transmit_hex16((uint16_t)ptr);
+    usart0_transmit_bytes_P(active_block(ptr) ? PSTR(" used ")
+                                              : PSTR(" free "));
+    usart0_transmit_uint16(block_size(ptr));
+#if !MALLOC_RELEASE
+    if (active_block(ptr) && *(ptr + block_size(ptr)) != MAGIC_NUMBER) {
+      usart0_transmit_bytes_P(PSTR(" guard overwritten"));
+    }
+#endif
+    usart0_transmit_byte(NEW_LINE);
+    usart0_transmit_byte(CARRIAGE_RETURN);
+  }
+  usart0_transmit_hex16((uint16_t)__HEAP_END);
+  usart0_transmit_bytes_P(PSTR(" top "));
+  usart0_transmit_uint16((uint16_t)(__HEAP_LIMIT - __HEAP_END));
+  usart0_transmit_byte(NEW_LINE);
+  usart0_transmit_byte(CARRIAGE_RETURN);
+}
+
+#if MALLOC_TRACK
+/**
+ * @function:
+ * print_site
+ * @description:
+ * transmit "file <id> line <n>" for a site packed by MALLOC_SITE
+ */
+static void print_site(uint16_t site) {
+  usart0_transmit_bytes_P(PSTR("file "));
+  usart0_transmit_uint16(site >> MALLOC_SITE_LINE_BITS);
+  usart0_transmit_bytes_P(PSTR(" line "));
+  usart0_transmit_uint16(site & MALLOC_SITE_LINE_MASK);
+}
+
+void heap_leak_report() {
+  usart0_transmit_bytes_P(PSTR("leak report"));
+  usart0_transmit_byte(NEW_LINE);
+  usart0_transmit_byte(CARRIAGE_RETURN);
+  for (uint8_t slot = 0; slot < MALLOC_TRACK_SLOTS; slot++) {
+    if (track_table[slot].offset == 0) {
+      continue;
+    }
+    uint16_t site = track_table[slot].site;
+    // a site is reported at its first entry in the table only
+    uint8_t reported = 0;
+    for (uint8_t before = 0; before < slot; before++) {
+      if (track_table[before].offset != 0 && track_table[before].site == site) {
+        reported = 1;
+        break;
+      }
+    }
+    if (reported) {
+      continue;
+    }
+    uint16_t blocks = 0;
+    uint16_t bytes = 0;
+    for (uint8_t other = slot; other < MALLOC_TRACK_SLOTS; other++) {
+      if (track_table[other].offset != 0 && track_table[other].site == site) {
+        blocks++;
+        bytes += block_size(offset_block(track_table[other].offset));
+      }
+    }
+    print_site(site);
+    usart0_transmit_bytes_P(PSTR(": "));
+    usart0_transmit_uint16(blocks);
+    usart0_transmit_bytes_P(PSTR(" blocks "));
+    usart0_transmit_uint16(bytes);
+    usart0_transmit_bytes_P(PSTR(" bytes"));
+    usart0_transmit_byte(NEW_LINE);
+    usart0_transmit_byte(CARRIAGE_RETURN);
+  }
+  if (track_dropped > 0) {
+    usart0_transmit_bytes_P(PSTR("untracked: "));
+    usart0_transmit_uint16(track_dropped);
+    usart0_transmit_bytes_P(PSTR(" blocks"));
+    usart0_transmit_byte(NEW_LINE);
+    usart0_transmit_byte(CARRIAGE_RETURN);
+  }
+}
+#endif
+
+void heap_check() { check_stack_heap_collision(); }
+
+void heap_set_panic_handler(void (*handler)(void_ptr_t)) {
+  panic_handler = handler != 0x0000 ? handler : heap_halt;
+}
+
 /**
  * @function:
  * get_errno
@@ -269,6 +1478,10 @@ uint8_ptr_t get_errno() {
     return (uint8_ptr_t) "Attempted to free unallocated block";
   case DOUBLE_FREE:
     return (uint8_ptr_t) "Double free";
+  case OUT_OF_BOUNDS_WRITE:
+    return (uint8_ptr_t) "Out of bounds write";
+  case INVALID_RESERVE_FREE:
+    return (uint8_ptr_t) "Invalid free of an ISR reserve slot";
   }
   return (uint8_ptr_t) "Unknown error";
-}
\ No newline at end of file
+}
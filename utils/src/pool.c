@@ -0,0 +1,126 @@
+#include "pool.h"
+#include "common.h"
+#include "types.h"
+
+/**
+ * @implementation_details:
+ * the error of the last pool function that returned -1, the same scheme as
+ * malloc.c. One variable for all pools.
+ *
+ * Error Definitions:
+ * 0: No error (Initial value)
+ * 1: pool_init got a slot size or count it can not handle
+ * 2: No free slot left
+ * 3: Tried to free a pointer that is not a slot of the pool
+ * 4: Double free
+ */
+enum ERRNO_VALUE {
+  NO_ERROR = 0,
+  INVALID_POOL,
+  POOL_EXHAUSTED,
+  ATTEMPTED_FREE_FOREIGN_SLOT,
+  DOUBLE_FREE
+};
+static enum ERRNO_VALUE ERNO = NO_ERROR;
+
+/**
+ * @function:
+ * slot_address
+ * @arguments: pool_t *pool, uint8_t index
+ * @return: uint8_ptr_t
+ * @description:
+ * the first byte of slot index. 16 bit multiply, no libgcc needed.
+ */
+static uint8_ptr_t slot_address(pool_t *pool, uint8_t index) {
+  return pool->region + (uint16_t)index * pool->slot_size;
+}
+
+/**
+ * @function:
+ * map_bit
+ * @arguments: uint8_t index
+ * @return: uint8_t
+ * @description:
+ * the mask of slot index in its byte of the bitmap (map[index >> 3])
+ */
+static uint8_t map_bit(uint8_t index) { return 1 << (index & 7); }
+
+int pool_init(pool_t *pool, uint8_ptr_t region, uint8_ptr_t map,
+              uint16_t slot_size, uint8_t count) {
+  // a free slot must hold the index of the next one. count is at most
+  // POOL_MAX_SLOTS by its type, so POOL_END is never an index.
+  if (slot_size == 0 || count == 0) {
+    ERNO = INVALID_POOL;
+    return -1;
+  }
+  pool->region = region;
+  pool->map = map;
+  pool->slot_size = slot_size;
+  pool->count = count;
+  pool->used = 0;
+  // chain every slot to the one after it, the last one ends the list
+  for (uint8_t index = 0; index < count; index++) {
+    *slot_address(pool, index) = index + 1 < count ? index + 1 : POOL_END;
+  }
+  pool->free_head = 0;
+  for (uint8_t byte = 0; byte < POOL_MAP_SIZE(count); byte++) {
+    map[byte] = 0;
+  }
+  return 0;
+}
+
+int pool_alloc(pool_t *pool, uint8_ptr_ptr_t ptr) {
+  uint8_t index = pool->free_head;
+  if (index == POOL_END) {
+    ERNO = POOL_EXHAUSTED;
+    return -1;
+  }
+  uint8_ptr_t slot = slot_address(pool, index);
+  pool->free_head = *slot;
+  pool->map[index >> 3] |= map_bit(index);
+  pool->used++;
+  *ptr = slot;
+  return 0;
+}
+
+int pool_free(pool_t *pool, uint8_ptr_t ptr) {
+  if (ptr < pool->region) {
+    ERNO = ATTEMPTED_FREE_FOREIGN_SLOT;
+    return -1;
+  }
+  // the offset must be a multiple of the slot size inside the region. divide
+  // always takes 16 steps, so this stays constant time.
+  uint16_t offset = (uint16_t)(ptr - pool->region);
+  uint16_t index = divide(offset, pool->slot_size);
+  if (index >= pool->count || index * pool->slot_size != offset) {
+    ERNO = ATTEMPTED_FREE_FOREIGN_SLOT;
+    return -1;
+  }
+  if ((pool->map[index >> 3] & map_bit(index)) == 0) {
+    ERNO = DOUBLE_FREE;
+    return -1;
+  }
+  pool->map[index >> 3] &= ~map_bit(index);
+  *ptr = pool->free_head;
+  pool->free_head = index;
+  pool->used--;
+  return 0;
+}
+
+uint8_t pool_available(pool_t *pool) { return pool->count - pool->used; }
+
+uint8_ptr_t pool_get_errno() {
+  switch (ERNO) {
+  case NO_ERROR:
+    return (uint8_ptr_t) "No error";
+  case INVALID_POOL:
+    return (uint8_ptr_t) "Invalid pool";
+  case POOL_EXHAUSTED:
+    return (uint8_ptr_t) "Pool exhausted";
+  case ATTEMPTED_FREE_FOREIGN_SLOT:
+    return (uint8_ptr_t) "Attempted to free a foreign slot";
+  case DOUBLE_FREE:
+    return (uint8_ptr_t) "Double free";
+  }
+  return (uint8_ptr_t) "Unknown error";
+}
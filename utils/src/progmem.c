@@ -0,0 +1,18 @@
+#include "progmem.h"
+#include "types.h"
+
+uint16_t strlen_P(uint8_flash_ptr_t str) {
+  uint8_flash_ptr_t end = str;
+  while (pgm_read_byte_inc(end)) {
+  };
+  // end is one past the terminator
+  return (uint16_t)(end - str) - 1;
+}
+
+void memcpy_P(uint8_ptr_t dest, uint8_flash_ptr_t src, uint16_t n) {
+  while (n) {
+    *dest = pgm_read_byte_inc(src);
+    dest++;
+    n--;
+  }
+}
@@ -0,0 +1,41 @@
+#include "stack.h"
+#include "avr-arch.h"
+#include "types.h"
+
+/**
+ * @implementation_details:
+ * __HEAP_LIMIT is defined in the linker script. It is the first byte the heap
+ * may not use, everything above it belongs to the stack. The lowest 2 bytes of
+ * the stack reserve hold the heap canary (see heap_check in malloc.h), the
+ * scan starts above them. We only care about the address (declared as an
+ * array so the name is the address).
+ */
+extern uint8_t __HEAP_LIMIT[];
+#define STACK_FLOOR (__HEAP_LIMIT + 2)
+
+/**
+ * @implementation_details:
+ * the lowest address the stack has written to that we know of. 0 means we
+ * have not scanned yet and the mark is just above RAMEND (empty stack).
+ */
+static uint8_ptr_t stack_mark = 0x0000;
+
+uint16_t stack_high_water() {
+  if (stack_mark == 0x0000) {
+    stack_mark = (uint8_ptr_t)(RAMEND + 1);
+  }
+  // walk up from the floor to the first byte that lost its paint. Scanning
+  // down from the mark would stop at a local the program never wrote (or one
+  // that holds 0xC5) and report less than the stack really used.
+  uint8_ptr_t current = STACK_FLOOR;
+  while (current < stack_mark && *current == STACK_PAINT) {
+    current++;
+  }
+  stack_mark = current;
+  return (uint16_t)((RAMEND + 1) - (uint16_t)stack_mark);
+}
+
+uint16_t stack_free_bytes() {
+  stack_high_water();
+  return (uint16_t)(stack_mark - STACK_FLOOR);
+}
@@ -1,24 +1,301 @@
+#include "usart.h"
 #include "avr-arch.h"
+#include "interrupt.h"
+#include "progmem.h"
 #include "types.h"
 
+/**
+ * @implementation_details:
+ * the transmit ring. tx_head and tx_tail are free running byte counters, the
+ * slot of a counter is counter & TX_MASK and tx_head - tx_tail (mod 256) is
+ * the number of queued bytes. Main only moves tx_head, the interrupt only
+ * moves tx_tail (except for USART_TX_OVERWRITE, which does it with interrupts
+ * disabled), and a byte is written before tx_head moves past it. A one byte
+ * counter is read and written in one instruction, so neither side ever sees
+ * half an update.
+ *
+ * tx_active is set when a byte goes into UDR0 (TXC0 is cleared at the same
+ * time) so usart0_flush knows whether there is a TXC0 to wait for.
+ */
+#define TX_MASK (USART0_TX_BUFFER_SIZE - 1)
+static volatile uint8_t tx_buffer[USART0_TX_BUFFER_SIZE];
+static volatile uint8_t tx_head = 0;
+static volatile uint8_t tx_tail = 0;
+static volatile uint8_t tx_active = 0;
+static uint16_t tx_dropped = 0;
+static usart_tx_policy_t tx_policy = USART_TX_BLOCK;
+
+/**
+ * @function:
+ * interrupts_enabled
+ * @return: the I bit of SREG
+ */
+static uint8_t interrupts_enabled() { return SREG & (1 << SREG7); }
+
+/**
+ * defined by image.ld only, an image of a multi-image flash has no vector
+ * table. Weak, its address is 0 in every other executable.
+ */
+extern uint8_t __image_no_vectors __attribute__((weak));
+
+/**
+ * @function:
+ * polled
+ * @return: 1 when the USART interrupts must stay off and both rings are
+ * served by polling (see @multi_image in usart.h)
+ */
+static uint8_t polled() { return &__image_no_vectors != 0; }
+
+/**
+ * @function:
+ * send
+ * @purpose:
+ * hand a byte to the transmitter, UDRE0 must be set. TXC0 is cleared by
+ * writing a one to it, FE0, DOR0 and UPE0 must be written as zero.
+ */
+static void send(uint8_t data) {
+  UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0);
+  UDR0 = data;
+  tx_active = 1;
+}
+
+/**
+ * @function:
+ * send_next
+ * @purpose:
+ * move the oldest queued byte into UDR0. Interrupts must be disabled (the
+ * interrupt itself, or main when it drains the ring without it).
+ */
+static void send_next() {
+  send(tx_buffer[tx_tail & TX_MASK]);
+  tx_tail++;
+}
+
+/**
+ * @function:
+ * send_queued
+ * @purpose:
+ * busy-wait the queued bytes out, for when interrupts are disabled
+ */
+static void send_queued() {
+  while (tx_head != tx_tail) {
+    while (!(UCSR0A & (1 << UDRE0))) {
+    };
+    send_next();
+  }
+}
+
+ISR(USART_UDRE_vect) {
+  if (tx_head != tx_tail) {
+    send_next();
+  }
+  if (tx_head == tx_tail) {
+    // nothing left, or the interrupt fires again right away
+    UCSR0B &= ~(1 << UDRIE0);
+  }
+}
+
+/**
+ * @function:
+ * queue
+ * @purpose:
+ * put one byte into the ring and apply the policy when the ring is full.
+ * With interrupts disabled nothing drains the ring: USART_TX_BLOCK sends the
+ * queued bytes and this one right away, USART_TX_DROP and USART_TX_OVERWRITE
+ * queue the byte (it goes out once interrupts are enabled again) or drop it
+ * without waiting for the transmitter. Without a vector table (polled) every
+ * byte is sent right away.
+ * @return: 1 if the byte was queued or sent, 0 if it was dropped
+ */
+static uint8_t queue(uint8_t data) {
+  uint8_t sreg = SREG;
+  if ((!(sreg & (1 << SREG7)) && tx_policy == USART_TX_BLOCK) || polled()) {
+    send_queued();
+    while (!(UCSR0A & (1 << UDRE0))) {
+    };
+    send(data);
+    return 1;
+  }
+  if ((uint8_t)(tx_head - tx_tail) == USART0_TX_BUFFER_SIZE) {
+    if (tx_policy == USART_TX_DROP) {
+      tx_dropped++;
+      return 0;
+    } else if (tx_policy == USART_TX_OVERWRITE) {
+      cli();
+      // the interrupt may have made room in the meantime
+      if ((uint8_t)(tx_head - tx_tail) == USART0_TX_BUFFER_SIZE) {
+        tx_tail++;
+        tx_dropped++;
+      }
+      SREG = sreg;
+    } else {
+      while ((uint8_t)(tx_head - tx_tail) == USART0_TX_BUFFER_SIZE) {
+      };
+    }
+  }
+  tx_buffer[tx_head & TX_MASK] = data;
+  tx_head++;
+  // the interrupt clears UDRIE0 too, change UCSR0B with interrupts disabled.
+  // Writing SREG back keeps them off for a caller that had them off.
+  cli();
+  UCSR0B |= (1 << UDRIE0);
+  SREG = sreg;
+  return 1;
+}
+
+/**
+ * @implementation_details:
+ * the receive ring, the same scheme as the transmit ring with the roles
+ * swapped: the interrupt only moves rx_head, main only moves rx_tail.
+ */
+#define RX_MASK (USART0_RX_BUFFER_SIZE - 1)
+static volatile uint8_t rx_buffer[USART0_RX_BUFFER_SIZE];
+static volatile uint8_t rx_head = 0;
+static volatile uint8_t rx_tail = 0;
+static volatile usart_rx_stats_t rx_stats;
+
+/**
+ * @function:
+ * receive
+ * @purpose:
+ * move the byte in UDR0 into the ring, or count why it was thrown away.
+ * Called by the interrupt, or by poll_receive without a vector table.
+ */
+static void receive() {
+  // the error flags belong to the byte in UDR0, read them before UDR0
+  uint8_t status = UCSR0A;
+  uint8_t data = UDR0;
+  if (status & (1 << DOR0)) {
+    rx_stats.data_overruns++;
+  }
+  if (status & (1 << FE0)) {
+    rx_stats.frame_errors++;
+    return;
+  }
+  if (status & (1 << UPE0)) {
+    rx_stats.parity_errors++;
+    return;
+  }
+  if ((uint8_t)(rx_head - rx_tail) == USART0_RX_BUFFER_SIZE) {
+    rx_stats.ring_overflows++;
+    return;
+  }
+  rx_buffer[rx_head & RX_MASK] = data;
+  rx_head++;
+}
+
+ISR(USART_RX_vect) { receive(); }
+
+/**
+ * @function:
+ * poll_receive
+ * @purpose:
+ * without a vector table take whatever the receiver holds (RXC0) into the
+ * ring. The hardware buffers two bytes, more than that between two calls is
+ * lost and counted as a data overrun.
+ */
+static void poll_receive() {
+  if (polled()) {
+    while (UCSR0A & (1 << RXC0)) {
+      receive();
+    }
+  }
+}
+
 void usart0_init(uint16_t ubrr_register_value) {
   /*ensure usart0 is not powered down*/
   PRR &= ~(1 << PRUSART0);
   /*Set baud rate */
   UBRR0H = (uint8_t)(ubrr_register_value >> 8);
   UBRR0L = (uint8_t)ubrr_register_value;
-  /* Enable transmitter */
-  UCSR0B = (1 << TXEN0);
+  /* empty receive ring */
+  rx_head = 0;
+  rx_tail = 0;
+  rx_stats.frame_errors = 0;
+  rx_stats.data_overruns = 0;
+  rx_stats.parity_errors = 0;
+  rx_stats.ring_overflows = 0;
+  /* Enable transmitter, receiver and the receive complete interrupt (not in
+   * an image without a vector table, it would reset the chip) */
+  UCSR0B = (1 << TXEN0) | (1 << RXEN0) | (polled() ? 0 : (1 << RXCIE0));
   /* Set frame format: 8data, 2stop bit, no parity */
   UCSR0C = (1 << USBS0) | (3 << UCSZ00);
+  /* empty transmit ring */
+  tx_head = 0;
+  tx_tail = 0;
+  tx_active = 0;
+  tx_dropped = 0;
+}
+
+void usart0_set_tx_policy(usart_tx_policy_t policy) { tx_policy = policy; }
+
+uint16_t usart0_write(uint8_ptr_t data, uint16_t length) {
+  uint16_t queued = 0;
+  for (uint16_t index = 0; index < length; index++) {
+    queued += queue(data[index]);
+  }
+  return queued;
 }
 
-void usart0_transmit_byte(uint8_t data) {
-  /* wait for the data buffer to be empty */
-  while (!(UCSR0A & (1 << UDRE0))) {
+void usart0_flush() {
+  // with interrupts disabled nobody else empties the ring
+  if (!interrupts_enabled()) {
+    send_queued();
+  }
+  while (tx_head != tx_tail) {
   };
-  /* Put data into buffer, sends the data */
-  UDR0 = data;
+  if (tx_active) {
+    while (!(UCSR0A & (1 << TXC0))) {
+    };
+    tx_active = 0;
+  }
+}
+
+uint16_t usart0_tx_dropped() { return tx_dropped; }
+
+void usart0_transmit_byte(uint8_t data) { queue(data); }
+
+uint8_t usart0_available() {
+  poll_receive();
+  return (uint8_t)(rx_head - rx_tail);
+}
+
+uint8_t usart0_read(uint8_ptr_t buffer, uint8_t length) {
+  poll_receive();
+  uint8_t count = 0;
+  while (count < length && rx_tail != rx_head) {
+    buffer[count++] = rx_buffer[rx_tail & RX_MASK];
+    rx_tail++;
+  }
+  return count;
+}
+
+uint8_t usart0_read_until(uint8_ptr_t buffer, uint8_t length,
+                          uint8_t terminator) {
+  poll_receive();
+  // rx_head is read once, bytes that arrive meanwhile wait for the next call
+  uint8_t available = (uint8_t)(rx_head - rx_tail);
+  uint8_t count = 0;
+  while (count < available && count < length) {
+    if (rx_buffer[(uint8_t)(rx_tail + count) & RX_MASK] == terminator) {
+      return usart0_read(buffer, count + 1);
+    }
+    count++;
+  }
+  if (count == length) {
+    return usart0_read(buffer, length);
+  }
+  return 0;
+}
+
+void usart0_rx_stats(usart_rx_stats_t *stats) {
+  uint8_t sreg = SREG;
+  cli();
+  stats->frame_errors = rx_stats.frame_errors;
+  stats->data_overruns = rx_stats.data_overruns;
+  stats->parity_errors = rx_stats.parity_errors;
+  stats->ring_overflows = rx_stats.ring_overflows;
+  SREG = sreg;
 }
 
 void usart0_transmit_bytes(uint8_ptr_t ptr) {
@@ -30,4 +307,53 @@ void usart0_transmit_bytes(uint8_ptr_t ptr) {
     usart0_transmit_byte(*(ptr + index));
     index++;
   }
-}
\ No newline at end of file
+}
+
+void usart0_transmit_bytes_P(uint8_flash_ptr_t ptr) {
+  uint8_t data = pgm_read_byte_inc(ptr);
+  while (data) {
+    usart0_transmit_byte(data);
+    data = pgm_read_byte_inc(ptr);
+  }
+}
+
+/**
+ * @function:
+ * transmit_digit
+ * @purpose:
+ * transmit the digit of *value at the given power of ten by counting how many
+ * times the power fits, then remove it from *value. Leading zeros are skipped
+ * until started is set.
+ * @return: started, or 1 once a digit has been transmitted
+ */
+static uint8_t transmit_digit(uint16_t *value, uint16_t power,
+                              uint8_t started) {
+  uint8_t digit = 0;
+  while (*value >= power) {
+    *value -= power;
+    digit++;
+  }
+  if (digit || started || power == 1) {
+    usart0_transmit_byte('0' + digit);
+    return 1;
+  }
+  return 0;
+}
+
+void usart0_transmit_uint16(uint16_t value) {
+  uint8_t started = 0;
+  started = transmit_digit(&value, 10000, started);
+  started = transmit_digit(&value, 1000, started);
+  started = transmit_digit(&value, 100, started);
+  started = transmit_digit(&value, 10, started);
+  transmit_digit(&value, 1, started);
+}
+
+void usart0_transmit_hex16(uint16_t value) {
+  usart0_transmit_byte('0');
+  usart0_transmit_byte('x');
+  for (uint8_t shift = 16; shift > 0; shift -= 4) {
+    uint8_t nibble = (value >> (shift - 4)) & 0x0f;
+    usart0_transmit_byte(nibble < 10 ? '0' + nibble : 'a' + nibble - 10);
+  }
+}